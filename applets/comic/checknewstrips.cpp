@@ -19,8 +19,14 @@
 
 #include "checknewstrips.h"
 
+#include <QDateTime>
+#include <QDebug>
 #include <QTimer>
 
+//number of comics checked at once and how long each check may take
+static const int MAX_CHECKS = 4;
+static const int CHECK_TIMEOUT = 60 * 1000;
+
 CheckNewStrips::CheckNewStrips( const QStringList &identifiers, Plasma::DataEngine *engine, int minutes, QObject *parent)
   : QObject( parent ),
     mMinutes( minutes ),
@@ -33,12 +39,18 @@ CheckNewStrips::CheckNewStrips( const QStringList &identifiers, Plasma::DataEngi
     connect( timer, SIGNAL(timeout()), this, SLOT(start()) );
     timer->start();
 
-    //start at once, that way the user does not have to wait for minutes to get the initial result
-    start();
+    //start at once, that way the user does not have to wait for minutes to get the initial result,
+    //but only once the results can be received
+    QTimer::singleShot( 0, this, SLOT(start()) );
 }
 
 void CheckNewStrips::dataUpdated( const QString &source, const Plasma::DataEngine::Data &data )
 {
+    if ( !mRunning.contains( source ) ) {
+        mEngine->disconnectSource( source, this );
+        return;
+    }
+
     QString lastIdentifierSuffix;
 
     if (!data[QStringLiteral("Error")].toBool()) {
@@ -46,32 +58,70 @@ void CheckNewStrips::dataUpdated( const QString &source, const Plasma::DataEngin
         lastIdentifierSuffix.remove( source );
     }
 
-    mEngine->disconnectSource( source, this );
-
     if ( !lastIdentifierSuffix.isEmpty() ) {
         QString temp = source;
         temp.remove(QLatin1Char(':'));
-        emit lastStrip( mIndex, temp, lastIdentifierSuffix );
+        emit lastStrip( mIdentifiers.indexOf( temp ), temp, lastIdentifierSuffix );
     }
-    ++mIndex;
 
-    if ( mIndex < mIdentifiers.count() ) {
-        const QString newSource = mIdentifiers[mIndex] + QLatin1Char(':');
-        mEngine->connectSource( newSource, this );
-    } else {
-        mIndex = 0;
-    }
+    finishCheck( source );
 }
 
 void CheckNewStrips::start()
 {
     //already running, do nothing
-    if ( mIndex ) {
+    if ( !mRunning.isEmpty() || ( mIndex && ( mIndex < mIdentifiers.count() ) ) ) {
         return;
     }
 
-    if ( mIndex < mIdentifiers.count() ) {
-        const QString newSource = mIdentifiers[mIndex] + QLatin1Char(':');
+    mIndex = 0;
+    startNext();
+}
+
+void CheckNewStrips::startNext()
+{
+    while ( ( mRunning.count() < MAX_CHECKS ) && ( mIndex < mIdentifiers.count() ) ) {
+        const int index = mIndex++;
+        const QString identifier = mIdentifiers[index];
+
+        //the engine looked for the newest strip recently for someone else, e.g. for another applet,
+        //the own previous check does not count, otherwise every other tick would reuse it
+        const Plasma::DataEngine::Data latest = mEngine->query( QLatin1String( "latest:" ) + identifier );
+        const QDateTime lastChecked = latest[QStringLiteral("Last checked")].toDateTime();
+        const QString lastSuffix = latest[QStringLiteral("Last strip identifier suffix")].toString();
+        const QDateTime ownCheck = mChecked.value( identifier );
+        if ( lastChecked.isValid() && !lastSuffix.isEmpty() && ( lastChecked.secsTo( QDateTime::currentDateTime() ) < mMinutes * 60 )
+             && ( !ownCheck.isValid() || ( lastChecked > ownCheck ) ) ) {
+            emit lastStrip( index, identifier, lastSuffix );
+            continue;
+        }
+
+        //one stuck comic does not hold up the others
+        const QString newSource = identifier + QLatin1Char(':');
+        QTimer *timer = new QTimer( this );
+        timer->setSingleShot( true );
+        timer->setInterval( CHECK_TIMEOUT );
+        connect( timer, &QTimer::timeout, this, [this, newSource]() {
+            qDebug() << "Checking for new strips timed out:" << newSource;
+            finishCheck( newSource );
+        } );
+        mRunning.insert( newSource, timer );
+        timer->start();
+
+        mEngine->query( QLatin1String( "setting_priority:prefetch:" ) + newSource );
         mEngine->connectSource( newSource, this );
     }
 }
+
+void CheckNewStrips::finishCheck( const QString &source )
+{
+    QTimer *timer = mRunning.take( source );
+    if ( !timer ) {
+        return;
+    }
+    timer->deleteLater();
+    mEngine->disconnectSource( source, this );
+    mChecked.insert( source.left( source.length() - 1 ), QDateTime::currentDateTime() );
+
+    startNext();
+}
@@ -22,9 +22,17 @@
 
 #include <Plasma/DataEngine>
 
+#include <QDateTime>
+
+class QTimer;
+
 /**
  * This class searches for the newest comic strips of predefined comics in a defined interval.
  * Once found it emits lastStrip
+ *
+ * A few comics are checked at once, each of them with its own timeout. Comics
+ * whose newest strip the engine found within the interval, after their last check by
+ * this class, are not checked again.
  */
 class CheckNewStrips : public QObject
 {
@@ -49,10 +57,15 @@ class CheckNewStrips : public QObject
         void start();
 
     private:
+        void startNext();
+        void finishCheck( const QString &source );
+
         int mMinutes;
         int mIndex;
         Plasma::DataEngine *mEngine;
         const QStringList mIdentifiers;
+        QHash< QString, QTimer* > mRunning;
+        QHash< QString, QDateTime > mChecked;
 };
 
 #endif
@@ -28,6 +28,8 @@
 #include "stripselector.h"
 #include "comicsaver.h"
 
+#include <QDateTime>
+#include <QDBusConnection>
 #include <QScreen>
 #include <QWindow>
 #include <QTimer>
@@ -53,6 +55,9 @@
 Q_GLOBAL_STATIC( ComicUpdater, globalComicUpdater )
 
 const int ComicApplet::CACHE_LIMIT = 20;
+const int ComicApplet::PREFETCH_DEPTH = 1;
+//the engine scales in steps as well, resizing does not request a new image all the time
+const int ComicApplet::SCALED_WIDTH_STEP = 256;
 
 ComicApplet::ComicApplet( QObject *parent, const QVariantList &args )
     : Plasma::Applet( parent, args ),
@@ -68,6 +73,7 @@ ComicApplet::ComicApplet( QObject *parent, const QVariantList &args )
       mMiddleClick( true ),
       mCheckNewComicStripsInterval(0),
       mMaxComicLimit( 0 ),
+      mPrefetchDepth( PREFETCH_DEPTH ),
       mCheckNewStrips(nullptr),
       mActionShop(nullptr),
       mEngine(nullptr),
@@ -92,9 +98,27 @@ void ComicApplet::init()
 
     mCurrentDay = QDate::currentDate();
     mDateChangedTimer = new QTimer( this );
+    mDateChangedTimer->setSingleShot( true );
+    mDateChangedTimer->setTimerType( Qt::PreciseTimer );
     connect( mDateChangedTimer, &QTimer::timeout, this, &ComicApplet::checkDayChanged );
-    mDateChangedTimer->setInterval( 5 * 60 * 1000 ); // every 5 minutes
-    mDateChangedTimer->start();
+    scheduleDayChange();
+
+    // after resuming or a change of the clock or the time zone the scheduled
+    // day change is off, so the date is looked at again then
+    QDBusConnection::systemBus().connect( QStringLiteral( "org.freedesktop.login1" ),
+                                          QStringLiteral( "/org/freedesktop/login1" ),
+                                          QStringLiteral( "org.freedesktop.login1.Manager" ),
+                                          QStringLiteral( "PrepareForSleep" ),
+                                          this, SLOT(prepareForSleep(bool)) );
+    QDBusConnection::systemBus().connect( QStringLiteral( "org.freedesktop.timedate1" ),
+                                          QStringLiteral( "/org/freedesktop/timedate1" ),
+                                          QStringLiteral( "org.freedesktop.DBus.Properties" ),
+                                          QStringLiteral( "PropertiesChanged" ),
+                                          this, SLOT(checkDayChanged()) );
+    QDBusConnection::sessionBus().connect( QString(), QString(),
+                                           QStringLiteral( "org.kde.kcmshell_clock" ),
+                                           QStringLiteral( "clockUpdated" ),
+                                           this, SLOT(checkDayChanged()) );
 
     mActionNextNewStripTab = new QAction(QIcon::fromTheme(QStringLiteral("go-next-view")),
                                          i18nc("@action comic strip", "&Next Tab with a New Strip"), this);
@@ -162,11 +186,34 @@ ComicApplet::~ComicApplet()
 
 void ComicApplet::dataUpdated( const QString &source, const Plasma::DataEngine::Data &data )
 {
+    if ( source.startsWith( QLatin1String( "scaled:" ) ) ) {
+        mEngine->disconnectSource( source, this );
+        if ( source == mScaledSource ) {
+            mScaledSource.clear();
+            if ( !data[QStringLiteral("Error")].toBool() ) {
+                mScaledImage = data[QStringLiteral("Image")].value<QImage>();
+                refreshComicData();
+            }
+        }
+        return;
+    }
+
     setBusy(false);
 
-    //disconnect prefetched comic strips
+    //disconnect prefetched comic strips, they are in the cache of the engine now
+    //and the strips following them can be prefetched
     if (mEngine && source != mOldSource ) {
         mEngine->disconnectSource( source, this );
+        if ( mPrefetches.contains( source ) ) {
+            const int distance = mPrefetches.take( source );
+            if ( !data[QStringLiteral("Error")].toBool() ) {
+                if ( distance > 0 ) {
+                    prefetch( data[QStringLiteral("Next identifier suffix")].toString(), distance + 1 );
+                } else {
+                    prefetch( data[QStringLiteral("Previous identifier suffix")].toString(), distance - 1 );
+                }
+            }
+        }
         return;
     }
 
@@ -185,6 +232,11 @@ void ComicApplet::dataUpdated( const QString &source, const Plasma::DataEngine::
     }
 
     mCurrent.setData(data);
+    mScaledImage = QImage();
+    if ( !mScaledSource.isEmpty() ) {
+        mEngine->disconnectSource( mScaledSource, this );
+        mScaledSource.clear();
+    }
 
     setAssociatedApplicationUrls(QList<QUrl>() << mCurrent.websiteUrl());
 
@@ -204,20 +256,20 @@ void ComicApplet::dataUpdated( const QString &source, const Plasma::DataEngine::
             mEngine->disconnectSource( source, this );
         }
 
-        //prefetch the previous and following comic for faster navigation
+        //prefetch the previous and following comics for faster navigation
         if (mCurrent.hasNext()) {
-            const QString prefetch = mCurrent.id() + QLatin1Char(':') + mCurrent.next();
-            mEngine->connectSource( prefetch, this );
+            prefetch( mCurrent.next(), 1 );
         }
         if ( mCurrent.hasPrev()) {
-            const QString prefetch = mCurrent.id() + QLatin1Char(':') + mCurrent.prev();
-            mEngine->connectSource( prefetch, this );
+            prefetch( mCurrent.prev(), -1 );
         }
     }
 
     updateView();
 
     refreshComicData();
+    requestScaledImage();
+    scheduleDayChange();
 }
 
 void ComicApplet::updateView()
@@ -332,6 +384,27 @@ void ComicApplet::checkDayChanged()
     } else if ( !mCurrent.hasImage() ) {
         updateComic( mCurrent.stored() );
     }
+
+    scheduleDayChange();
+}
+
+void ComicApplet::scheduleDayChange()
+{
+    // without a strip retry every 5 minutes, otherwise wait for the next day
+    int interval = 5 * 60 * 1000;
+    if ( mCurrent.hasImage() ) {
+        const QDateTime now = QDateTime::currentDateTime();
+        const QDateTime midnight( now.date().addDays( 1 ), QTime( 0, 0 ) );
+        interval = int( qMax( now.msecsTo( midnight ), qint64( 0 ) ) ) + 1000;
+    }
+    mDateChangedTimer->start( interval );
+}
+
+void ComicApplet::prepareForSleep( bool sleep )
+{
+    if ( !sleep ) {
+        checkDayChanged();
+    }
 }
 
 void ComicApplet::configChanged()
@@ -356,6 +429,8 @@ void ComicApplet::configChanged()
     mMiddleClick = cg.readEntry( "middleClick", true );
     mCheckNewComicStripsInterval = cg.readEntry( "checkNewComicStripsIntervall", 30 );
 
+    mPrefetchDepth = qMax( cg.readEntry( "prefetchDepth", PREFETCH_DEPTH ), 0 );
+
     auto oldMaxComicLimit = mMaxComicLimit;
     mMaxComicLimit = cg.readEntry( "maxComicLimit", CACHE_LIMIT );
     if (oldMaxComicLimit != mMaxComicLimit && mEngine) {
@@ -380,6 +455,7 @@ void ComicApplet::saveConfig()
     cg.writeEntry( "tabIdentifier", mTabIdentifier );
     cg.writeEntry( "checkNewComicStripsIntervall", mCheckNewComicStripsInterval );
     cg.writeEntry( "maxComicLimit", mMaxComicLimit);
+    cg.writeEntry( "prefetchDepth", mPrefetchDepth );
 
     globalComicUpdater->save();
 }
@@ -422,6 +498,11 @@ void ComicApplet::slotFoundLastStrip( int index, const QString &identifier, cons
 
 void ComicApplet::slotGoJump()
 {
+    //the range comes from the strips known to the engine, without asking the website
+    if (mEngine) {
+        mCurrent.setNavigation(mEngine->query(QLatin1String("navigation:") + mCurrent.id()));
+    }
+
     StripSelector *selector = StripSelectorFactory::create(mCurrent.type());
     connect(selector, &StripSelector::stripChosen, this, &ComicApplet::updateComic);
 
@@ -503,6 +584,13 @@ void ComicApplet::updateComic( const QString &identifierSuffix )
             mEngine->disconnectSource( mOldSource, this );
         }
         mOldSource = identifier;
+
+        //the strip might already be prefetched, it is needed now; if the user
+        //jumped somewhere else the other prefetched strips are not needed anymore
+        if ( !mPrefetches.remove( identifier ) ) {
+            cancelPrefetches();
+        }
+        mEngine->query( QLatin1String( "setting_priority:interactive:" ) + identifier );
         mEngine->connectSource( identifier, this );
         slotScaleToContent();
     } else {
@@ -512,6 +600,66 @@ void ComicApplet::updateComic( const QString &identifierSuffix )
     updateContextMenu();
 }
 
+void ComicApplet::prefetch( const QString &suffix, int distance )
+{
+    if ( !mEngine || suffix.isEmpty() || ( qAbs( distance ) > mPrefetchDepth ) ) {
+        return;
+    }
+
+    const QString identifier = mCurrent.id() + QLatin1Char(':') + suffix;
+    if ( ( identifier == mOldSource ) || mPrefetches.contains( identifier ) ) {
+        return;
+    }
+
+    //without slowing down what is displayed
+    mPrefetches.insert( identifier, distance );
+    mEngine->query( QLatin1String( "setting_priority:prefetch:" ) + identifier );
+    mEngine->connectSource( identifier, this );
+}
+
+void ComicApplet::cancelPrefetches()
+{
+    //the engine drops the requests nobody is connected to anymore
+    if ( mEngine ) {
+        for ( auto it = mPrefetches.constBegin(); it != mPrefetches.constEnd(); ++it ) {
+            mEngine->disconnectSource( it.key(), this );
+        }
+    }
+    mPrefetches.clear();
+}
+
+void ComicApplet::requestScaledImage()
+{
+    const QImage image = mCurrent.image();
+    if ( !mEngine || mCurrent.scaleComic() || image.isNull() || mDisplaySize.isEmpty() ) {
+        return;
+    }
+
+    //the strip is fit into the view
+    int width = qMin( mDisplaySize.width(), mDisplaySize.height() * image.width() / qMax( image.height(), 1 ) );
+    width = ( width + SCALED_WIDTH_STEP - 1 ) / SCALED_WIDTH_STEP * SCALED_WIDTH_STEP;
+    if ( width >= image.width() ) {
+        if ( !mScaledImage.isNull() ) {
+            mScaledImage = QImage();
+            refreshComicData();
+        }
+        return;
+    }
+    if ( mScaledImage.width() == width ) {
+        return;
+    }
+
+    const QString source = QLatin1String( "scaled:" ) + QString::number( width ) + QLatin1Char( ':' ) + mOldSource;
+    if ( source == mScaledSource ) {
+        return;
+    }
+    if ( !mScaledSource.isEmpty() ) {
+        mEngine->disconnectSource( mScaledSource, this );
+    }
+    mScaledSource = source;
+    mEngine->connectSource( source, this );
+}
+
 void ComicApplet::updateContextMenu()
 {
     if (mCurrent.id().isEmpty()) {
@@ -696,7 +844,9 @@ void ComicApplet::setTabIdentifiers(const QStringList &tabs)
 
 void ComicApplet::refreshComicData()
 {
-    mComicData[QStringLiteral("image")] = mCurrent.image();
+    //"Actual Size" shows the original strip, otherwise one fitting the view is enough
+    mComicData[QStringLiteral("image")] = ( mCurrent.scaleComic() || mScaledImage.isNull() ) ? mCurrent.image() : mScaledImage;
+    mComicData[QStringLiteral("fullImage")] = mCurrent.image();
     mComicData[QStringLiteral("prev")] = mCurrent.prev();
     mComicData[QStringLiteral("next")] = mCurrent.next();
     mComicData[QStringLiteral("additionalText")] = mCurrent.additionalText();
@@ -735,6 +885,8 @@ void ComicApplet::setShowActualSize(bool show)
     mCurrent.setScaleComic(show);
 
     emit showActualSizeChanged();
+    refreshComicData();
+    requestScaledImage();
 }
 
 int ComicApplet::checkNewComicStripsInterval() const
@@ -782,6 +934,37 @@ int ComicApplet::maxComicLimit() const
     return mMaxComicLimit;
 }
 
+void ComicApplet::setPrefetchDepth(int depth)
+{
+    if (mPrefetchDepth == depth) {
+        return;
+    }
+
+    mPrefetchDepth = depth;
+    emit prefetchDepthChanged();
+}
+
+int ComicApplet::prefetchDepth() const
+{
+    return mPrefetchDepth;
+}
+
+void ComicApplet::setDisplaySize(const QSize &size)
+{
+    if (mDisplaySize == size) {
+        return;
+    }
+
+    mDisplaySize = size;
+    emit displaySizeChanged();
+    requestScaledImage();
+}
+
+QSize ComicApplet::displaySize() const
+{
+    return mDisplaySize;
+}
+
 //Endof QML
 void ComicApplet::setTabHighlighted(const QString &id, bool highlight)
 {
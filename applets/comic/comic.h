@@ -68,6 +68,8 @@ class ComicApplet : public Plasma::Applet, public Plasma::DataEngineConsumer
     Q_PROPERTY(int checkNewComicStripsInterval READ checkNewComicStripsInterval WRITE setCheckNewComicStripsInterval NOTIFY checkNewComicStripsIntervalChanged)
     Q_PROPERTY(int providerUpdateInterval READ providerUpdateInterval WRITE setProviderUpdateInterval NOTIFY providerUpdateIntervalChanged)
     Q_PROPERTY(int maxComicLimit READ maxComicLimit WRITE setMaxComicLimit NOTIFY maxComicLimitChanged)
+    Q_PROPERTY(int prefetchDepth READ prefetchDepth WRITE setPrefetchDepth NOTIFY prefetchDepthChanged)
+    Q_PROPERTY(QSize displaySize READ displaySize WRITE setDisplaySize NOTIFY displaySizeChanged)
 
     public:
         ComicApplet( QObject *parent, const QVariantList &args );
@@ -116,6 +118,12 @@ class ComicApplet : public Plasma::Applet, public Plasma::DataEngineConsumer
 
         void setMaxComicLimit(int limit);
         int maxComicLimit() const;
+
+        void setPrefetchDepth(int depth);
+        int prefetchDepth() const;
+
+        void setDisplaySize(const QSize &size);
+        QSize displaySize() const;
         //End for QML
 
 Q_SIGNALS:
@@ -135,6 +143,8 @@ Q_SIGNALS:
     void checkNewComicStripsIntervalChanged();
     void providerUpdateIntervalChanged();
     void maxComicLimitChanged();
+    void prefetchDepthChanged();
+    void displaySizeChanged();
 
     public Q_SLOTS:
         void dataUpdated( const QString &name, const Plasma::DataEngine::Data &data );
@@ -152,6 +162,7 @@ Q_SIGNALS:
         void slotShop();
         void slotStorePosition();
         void checkDayChanged();
+        void prepareForSleep( bool sleep );
         void createComicBook();
         void slotArchive( int archiveType, const QUrl &dest, const QString &fromIdentifier, const QString &toIdentifier );
         void slotArchiveFinished( KJob *job );
@@ -175,8 +186,29 @@ Q_SIGNALS:
         void setTabHighlighted(const QString &id, bool highlight);
         bool isTabHighlighted(const QString &id) const;
 
+        /**
+         * Requests the strip with suffix in the background, distance is its
+         * number of strips before (negative) or after the displayed strip.
+         * The following strips are requested once it arrived, up to prefetchDepth.
+         */
+        void prefetch( const QString &suffix, int distance );
+        void cancelPrefetches();
+
+        /**
+         * Requests the displayed strip downscaled to the size it is shown at,
+         * unless it is shown at its actual size.
+         */
+        void requestScaledImage();
+
+        /**
+         * Arms the timer for the next check whether the day changed.
+         */
+        void scheduleDayChange();
+
     private:
         static const int CACHE_LIMIT;
+        static const int PREFETCH_DEPTH;
+        static const int SCALED_WIDTH_STEP;
         ComicModel *mModel;
         QSortFilterProxyModel *mProxy;
         ActiveComicModel *mActiveComicModel;
@@ -186,6 +218,10 @@ Q_SIGNALS:
 
         QString mIdentifierError;
         QString mOldSource;
+        QHash<QString, int> mPrefetches;
+        QString mScaledSource;
+        QImage mScaledImage;
+        QSize mDisplaySize;
         ConfigWidget *mConfigWidget;
         bool mDifferentComic;
         bool mShowComicUrl;
@@ -197,6 +233,7 @@ Q_SIGNALS:
         bool mMiddleClick;
         int mCheckNewComicStripsInterval;
         int mMaxComicLimit;
+        int mPrefetchDepth;
         CheckNewStrips *mCheckNewStrips;
         QTimer *mDateChangedTimer;
         QList<QAction*> mActions;
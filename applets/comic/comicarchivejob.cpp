@@ -20,13 +20,95 @@
 
 #include "comicarchivejob.h"
 
+#include <QBuffer>
 #include <QDebug>
+#include <QFile>
+#include <QImageReader>
 #include <QTemporaryFile>
+#include <QtEndian>
 #include <KZip>
 #include <klocalizedstring.h>
 
 #include <QImage>
 
+#include <cstdio>
+
+//number of strips downloaded at once, the results wait until the link chain reaches them
+static const int PIPELINE_DEPTH = 4;
+
+//We use 6 signs, e.g. number 1 --> 000001.png, 123 --> 000123.png
+//this way the comics should always be correctly sorted (otherwise evince e.g. has problems)
+static const int NUM_SIGNS = 6;
+
+//strips archived backward are numbered down from here and renumbered at the end
+static const int BACKWARD_BASE = 1000000;
+
+static QString entryNumber( int number )
+{
+    return QStringLiteral( "%1" ).arg( number, NUM_SIGNS, 10, QLatin1Char( '0' ) );
+}
+
+/**
+ * Renames the count entries numbered down from BACKWARD_BASE to 1 ... count
+ * in place, as all names keep their length only the zip headers are patched
+ */
+static bool renumberBackwardEntries( const QString &path, int count )
+{
+    QFile file( path );
+    if ( !file.open( QIODevice::ReadWrite ) ) {
+        return false;
+    }
+
+    //the end of central directory record is followed by at most a comment
+    const qint64 size = file.size();
+    const qint64 tailSize = qMin( size, qint64( 22 + 0xFFFF ) );
+    file.seek( size - tailSize );
+    const QByteArray tail = file.read( tailSize );
+    const int end = tail.lastIndexOf( QByteArray( "PK\x05\x06", 4 ) );
+    if ( ( end == -1 ) || ( end + 22 > tail.size() ) ) {
+        return false;
+    }
+    const int entries = qFromLittleEndian<quint16>( reinterpret_cast<const uchar*>( tail.constData() + end + 10 ) );
+    const quint32 directorySize = qFromLittleEndian<quint32>( reinterpret_cast<const uchar*>( tail.constData() + end + 12 ) );
+    const quint32 directoryOffset = qFromLittleEndian<quint32>( reinterpret_cast<const uchar*>( tail.constData() + end + 16 ) );
+
+    file.seek( directoryOffset );
+    QByteArray directory = file.read( directorySize );
+    int pos = 0;
+    for ( int i = 0; i < entries; ++i ) {
+        if ( ( pos + 46 > directory.size() ) || !directory.mid( pos, 4 ).startsWith( QByteArray( "PK\x01\x02", 4 ) ) ) {
+            return false;
+        }
+        const uchar *header = reinterpret_cast<const uchar*>( directory.constData() + pos );
+        const int nameLength = qFromLittleEndian<quint16>( header + 28 );
+        const int extraLength = qFromLittleEndian<quint16>( header + 30 );
+        const int commentLength = qFromLittleEndian<quint16>( header + 32 );
+        const quint32 localOffset = qFromLittleEndian<quint32>( header + 42 );
+        const QByteArray name = directory.mid( pos + 46, nameLength );
+
+        bool ok;
+        const int index = BACKWARD_BASE - name.left( NUM_SIGNS ).toInt( &ok );
+        if ( ok && ( index >= 1 ) && ( index <= count ) ) {
+            const QByteArray renamed = entryNumber( count + 1 - index ).toLatin1() + name.mid( NUM_SIGNS );
+            directory.replace( pos + 46, nameLength, renamed );
+
+            //the local header has the name right after its 30 fixed bytes
+            file.seek( localOffset );
+            const QByteArray local = file.read( 30 );
+            if ( ( local.size() != 30 ) || !local.startsWith( QByteArray( "PK\x03\x04", 4 ) ) ||
+                 ( qFromLittleEndian<quint16>( reinterpret_cast<const uchar*>( local.constData() + 26 ) ) != nameLength ) ) {
+                return false;
+            }
+            file.seek( localOffset + 30 );
+            file.write( renamed );
+        }
+        pos += 46 + nameLength + extraLength + commentLength;
+    }
+
+    file.seek( directoryOffset );
+    return ( file.write( directory ) == directory.size() ) && file.flush();
+}
+
 ComicArchiveJob::ComicArchiveJob( const QUrl &dest, Plasma::DataEngine *engine, ComicArchiveJob::ArchiveType archiveType, IdentifierType identifierType, const QString &pluginName, QObject *parent )
   : KJob( parent ),
     mType( archiveType ),
@@ -40,19 +122,29 @@ ComicArchiveJob::ComicArchiveJob( const QUrl &dest, Plasma::DataEngine *engine,
     mProcessedFiles( 0 ),
     mTotalFiles( -1 ),
     mEngine( engine ),
-    mZipFile( new QTemporaryFile ),
+    mZipFile(nullptr),
     mZip(nullptr),
     mPluginName( pluginName ),
     mDest( dest )
 {
+    //the archive is written to a temporary file, so a failed or killed job leaves an existing
+    //archive untouched, a local one is written next to the destination to be renamed once complete
+    if ( mDest.isLocalFile() ) {
+        mZipFile = new QTemporaryFile( mDest.toLocalFile() + QLatin1String( ".XXXXXX" ) );
+    } else {
+        mZipFile = new QTemporaryFile;
+    }
     if ( mZipFile->open() ) {
         mZip = new KZip( mZipFile->fileName() );
         mZip->open( QIODevice::ReadWrite );
-        mZip->setCompression( KZip::NoCompression );
-        setCapabilities( Killable | Suspendable );
     } else {
         qWarning() << "Could not create a temporary file for the zip file.";
     }
+
+    if ( mZip ) {
+        mZip->setCompression( KZip::NoCompression );
+        setCapabilities( Killable | Suspendable );
+    }
 }
 
 ComicArchiveJob::~ComicArchiveJob()
@@ -60,7 +152,6 @@ ComicArchiveJob::~ComicArchiveJob()
     emitResultIfNeeded();
     delete mZip;
     delete mZipFile;
-    qDeleteAll( mBackwardFiles );
 }
 
 bool ComicArchiveJob::isValid() const
@@ -107,12 +198,20 @@ void ComicArchiveJob::setFromIdentifier( const QString &fromIdentifier )
 
 void ComicArchiveJob::start()
 {
+    loadNavigation();
+
     switch ( mType ) {
         case ArchiveAll:
-            requestComic( suffixToIdentifier( QString() ) );
-            break;
         case ArchiveStartTo:
-            requestComic( mToIdentifier );
+            //the first strip is known already, no need to look it up at the website
+            if ( !mFirstKnownSuffix.isEmpty() ) {
+                mDirection = Forward;
+                setFromIdentifier( suffixToIdentifier( mFirstKnownSuffix ) );
+                defineTotalNumber();
+                requestComic( mFromIdentifier );
+            } else {
+                requestComic( mType == ArchiveAll ? suffixToIdentifier( QString() ) : mToIdentifier );
+            }
             break;
         case ArchiveEndTo: {
             setFromIdentifier( mToIdentifier );
@@ -130,6 +229,36 @@ void ComicArchiveJob::start()
 }
 
 void ComicArchiveJob::dataUpdated( const QString &source, const Plasma::DataEngine::Data &data )
+{
+    mEngine->disconnectSource( source, this );
+    mInFlight.remove( source );
+
+    //strips requested ahead of time wait until the link chain reaches them,
+    //if they failed they get requested again then
+    if ( source != mExpected ) {
+        const bool hasError = data[QStringLiteral("Error")].toBool() || data[QStringLiteral("Image")].value<QImage>().isNull();
+        if ( !hasError && !mDone ) {
+            mReady.insert( source, data );
+        }
+        return;
+    }
+
+    mExpected.clear();
+    processStrip( source, data );
+}
+
+void ComicArchiveJob::processReady()
+{
+    if ( mExpected.isEmpty() || !mReady.contains( mExpected ) ) {
+        return;
+    }
+
+    const QString source = mExpected;
+    mExpected.clear();
+    processStrip( source, mReady.take( source ) );
+}
+
+void ComicArchiveJob::processStrip( const QString &source, const Plasma::DataEngine::Data &data )
 {
     if ( !mZip ) {
         qWarning() << "No zip file, aborting.";
@@ -143,7 +272,7 @@ void ComicArchiveJob::dataUpdated( const QString &source, const Plasma::DataEngi
     QString currentIdentifierSuffix = currentIdentifier;
     currentIdentifierSuffix.remove(mPluginName + QLatin1Char(':'));
 
-    const QImage image = data[QStringLiteral("Image")].value<QImage>();
+    QImage image = data[QStringLiteral("Image")].value<QImage>();
     const bool hasError = data[QStringLiteral("Error")].toBool() || image.isNull();
     const QString previousIdentifierSuffix = data[QStringLiteral("Previous identifier suffix")].toString();
     const QString nextIdentifierSuffix = data[QStringLiteral("Next identifier suffix")].toString();
@@ -164,7 +293,8 @@ void ComicArchiveJob::dataUpdated( const QString &source, const Plasma::DataEngi
         qWarning() << "An error occurred at" << source << "stopping.";
         setErrorText( i18n( "An error happened for identifier %1.", source ) );
         setError( KilledJobError );
-        copyZipFileToDestination();
+        //the partial archive is dropped together with the temporary file
+        emitResultIfNeeded();
         return;
     }
 
@@ -193,14 +323,17 @@ void ComicArchiveJob::dataUpdated( const QString &source, const Plasma::DataEngi
         }
     }
 
+    //store the strip as downloaded if it is in the cache already
+    QByteArray imageData;
+    QFile imageFile( data[QStringLiteral("Image Path")].toString() );
+    if ( imageFile.open( QIODevice::ReadOnly ) ) {
+        imageData = imageFile.readAll();
+    }
+
     bool worked = false;
     ++mProcessedFiles;
     if ( mDirection == Forward ) {
-        QTemporaryFile tempFile;
-        worked = tempFile.open();
-        worked = worked && tempFile.flush();
-        worked = ( worked ? image.save( tempFile.fileName(), "PNG" ) : worked );
-        worked = ( worked ? addFileToZip( tempFile.fileName() ) : worked );
+        worked = addImageToZip( image, imageData );
 
         if ( worked ) {
             if ( ( currentIdentifier == mToIdentifier ) || ( currentIdentifierSuffix == nextIdentifierSuffix) || nextIdentifierSuffix.isEmpty() ) {
@@ -211,16 +344,12 @@ void ComicArchiveJob::dataUpdated( const QString &source, const Plasma::DataEngi
             }
         }
     } else if ( mDirection == Backward ) {
-        QTemporaryFile *tempFile = new QTemporaryFile;
-        mBackwardFiles << tempFile;
-        worked = tempFile->open();
-        worked = worked && tempFile->flush();
-        worked = ( worked ? image.save( tempFile->fileName(), "PNG" ) : worked );
+        worked = addImageToZip( image, imageData );
 
         if ( worked ) {
             if ( ( currentIdentifier == mToIdentifier ) || ( currentIdentifierSuffix == previousIdentifierSuffix ) || previousIdentifierSuffix.isEmpty() ) {
                 qDebug() << "Done downloading at:" << source;
-                createBackwardZip();
+                copyZipFileToDestination();
             } else {
                 requestComic( suffixToIdentifier( previousIdentifierSuffix) );
             }
@@ -239,8 +368,6 @@ void ComicArchiveJob::dataUpdated( const QString &source, const Plasma::DataEngi
         setError( KilledJobError );
         emitResultIfNeeded();
     }
-
-    mEngine->disconnectSource( source, this );
 }
 
 bool ComicArchiveJob::doKill()
@@ -275,9 +402,15 @@ void ComicArchiveJob::defineTotalNumber( const QString &currentSuffix )
     //calculate a new value for total files, can be different from the previous one,
     //if there are no strips for certain days/numbers
     if ( !currentSuffix.isEmpty() ) {
-        if ( mIdentifierType == Date ) {
+        const QString toSuffix = totalToSuffix();
+        const int currentPosition = knownPosition( currentSuffix );
+        const int toPosition = knownPosition( toSuffix );
+        if ( ( currentPosition != -1 ) && ( toPosition != -1 ) ) {
+            //processed files + files still to download
+            mTotalFiles = mProcessedFiles + qAbs( toPosition - currentPosition );
+        } else if ( mIdentifierType == Date ) {
             const QDate current = QDate::fromString(currentSuffix, QStringLiteral("yyyy-MM-dd"));
-            const QDate to = QDate::fromString(mToIdentifierSuffix, QStringLiteral("yyyy-MM-dd"));
+            const QDate to = QDate::fromString(toSuffix, QStringLiteral("yyyy-MM-dd"));
             if ( current.isValid() && to.isValid() ) {
                 //processed files + files still to download
                 mTotalFiles = mProcessedFiles + qAbs( current.daysTo( to ) );
@@ -287,7 +420,7 @@ void ComicArchiveJob::defineTotalNumber( const QString &currentSuffix )
             bool ok;
             const int current = currentSuffix.toInt( &ok );
             result = ( result && ok );
-            const int to = mToIdentifierSuffix.toInt( &ok );
+            const int to = toSuffix.toInt( &ok );
             result = ( result && ok );
             if ( result ) {
                 //processed files + files still to download
@@ -307,9 +440,15 @@ void ComicArchiveJob::findTotalNumberFromTo()
         return;
     }
 
-    if ( mIdentifierType == Date ) {
+    const QString toSuffix = totalToSuffix();
+    const int fromPosition = knownPosition( mFromIdentifierSuffix );
+    const int toPosition = knownPosition( toSuffix );
+    if ( ( fromPosition != -1 ) && ( toPosition != -1 ) ) {
+        //the known strips also work for String identifiers and for gaps in dates/numbers
+        mTotalFiles = qAbs( toPosition - fromPosition ) + 1;
+    } else if ( mIdentifierType == Date ) {
         const QDate from = QDate::fromString( mFromIdentifierSuffix, QStringLiteral("yyyy-MM-dd"));
-        const QDate to = QDate::fromString(mToIdentifierSuffix, QStringLiteral("yyyy-MM-dd"));
+        const QDate to = QDate::fromString(toSuffix, QStringLiteral("yyyy-MM-dd"));
         if ( from.isValid() && to.isValid() ) {
             mTotalFiles = qAbs( from.daysTo( to ) ) + 1;
         }
@@ -318,7 +457,7 @@ void ComicArchiveJob::findTotalNumberFromTo()
         bool ok;
         const int from = mFromIdentifierSuffix.toInt( &ok );
         result = ( result && ok );
-        const int to = mToIdentifierSuffix.toInt( &ok );
+        const int to = toSuffix.toInt( &ok );
         result = ( result && ok );
         if ( result ) {
             mTotalFiles = qAbs( to - from ) + 1;
@@ -326,6 +465,32 @@ void ComicArchiveJob::findTotalNumberFromTo()
     }
 }
 
+void ComicArchiveJob::loadNavigation()
+{
+    const Plasma::DataEngine::Data navigation = mEngine->query( QLatin1String( "navigation:" ) + mPluginName );
+    mFirstKnownSuffix = navigation[QStringLiteral("First strip identifier suffix")].toString();
+    mLastKnownSuffix = navigation[QStringLiteral("Last strip identifier suffix")].toString();
+
+    mKnownPositions.clear();
+    mKnownSuffixes = navigation[QStringLiteral("Identifier suffixes")].toStringList();
+    for ( int i = 0; i < mKnownSuffixes.count(); ++i ) {
+        mKnownPositions.insert( mKnownSuffixes[i], i );
+    }
+}
+
+int ComicArchiveJob::knownPosition( const QString &suffix ) const
+{
+    return mKnownPositions.value( suffix, -1 );
+}
+
+QString ComicArchiveJob::totalToSuffix() const
+{
+    if ( mToIdentifierSuffix.isEmpty() && ( mDirection == Forward ) ) {
+        return mLastKnownSuffix;
+    }
+    return mToIdentifierSuffix;
+}
+
 QString ComicArchiveJob::suffixToIdentifier( const QString &suffix ) const
 {
     return mPluginName + QLatin1Char(':') + suffix;
@@ -343,56 +508,170 @@ void ComicArchiveJob::requestComic( QString identifier ) //krazy:exclude=passbyv
                       qMakePair(QStringLiteral("source"), identifier),
                       qMakePair(QStringLiteral("destination"), mDest.toString()));
 
+    mExpected = identifier;
+    if ( mReady.contains( identifier ) ) {
+        QMetaObject::invokeMethod( this, "processReady", Qt::QueuedConnection );
+    } else if ( !mInFlight.contains( identifier ) ) {
+        connectComic( identifier );
+    }
+    prefetch();
+}
+
+void ComicArchiveJob::connectComic( const QString &identifier )
+{
+    //the data might be delivered right away
+    mInFlight.insert( identifier );
+    mEngine->query( QLatin1String( "setting_priority:archive:" ) + identifier );
     mEngine->connectSource( identifier, this );
 //    mEngine->query( identifier );
 }
 
-bool ComicArchiveJob::addFileToZip( const QString &path )
+void ComicArchiveJob::prefetch()
 {
-    //We use 6 signs, e.g. number 1 --> 000001.png, 123 --> 000123.png
-    //this way the comics should always be correctly sorted (otherwise evince e.g. has problems)
-    static const int numSigns = 6;
-    static const QString zero = QLatin1String( "0" );
-    QString number = QString::number( ++mComicNumber );
-    const int length = number.length();
-    if ( length < numSigns ) {
-        number = zero.repeated( numSigns - length ) + number;
+    if ( mDone || mSuspend || ( mDirection == Undefined ) || mExpected.isEmpty() ) {
+        return;
+    }
+
+    QStringList predicted;
+    QString suffix = mExpected.mid( mPluginName.length() + 1 );
+    while ( predicted.count() < PIPELINE_DEPTH ) {
+        suffix = predictSuffix( suffix );
+        if ( suffix.isEmpty() ) {
+            break;
+        }
+        predicted << suffixToIdentifier( suffix );
     }
 
-    return mZip->addLocalFile( path, number + QLatin1String( ".png" ) );
+    //wrong guesses, e.g. dates without a strip, would block the pipeline
+    QHash< QString, Plasma::DataEngine::Data >::iterator it = mReady.begin();
+    while ( it != mReady.end() ) {
+        if ( ( it.key() != mExpected ) && !predicted.contains( it.key() ) ) {
+            it = mReady.erase( it );
+        } else {
+            ++it;
+        }
+    }
+
+    for ( const QString &identifier : qAsConst( predicted ) ) {
+        if ( mInFlight.count() + mReady.count() >= PIPELINE_DEPTH ) {
+            break;
+        }
+        if ( !mReady.contains( identifier ) && !mInFlight.contains( identifier ) ) {
+            connectComic( identifier );
+        }
+    }
 }
 
-void ComicArchiveJob::createBackwardZip()
+QString ComicArchiveJob::predictSuffix( const QString &suffix ) const
 {
-    for ( int i = mBackwardFiles.count() - 1; i >= 0; --i ) {
-        if ( !addFileToZip( mBackwardFiles[i]->fileName() ) ) {
-            qWarning() << "Failed adding a file to the archive.";
-            setErrorText( i18n( "Failed adding a file to the archive." ) );
-            setError( KilledJobError );
-            emitResultIfNeeded();
-            return;
+    if ( suffix.isEmpty() || ( suffix == mToIdentifierSuffix ) ) {
+        return QString();
+    }
+
+    const int step = ( mDirection == Forward ? 1 : -1 );
+    const int position = knownPosition( suffix );
+    if ( position != -1 ) {
+        return mKnownSuffixes.value( position + step );
+    }
+
+    if ( mIdentifierType == Date ) {
+        const QDate date = QDate::fromString( suffix, QStringLiteral( "yyyy-MM-dd" ) );
+        const QDate to = QDate::fromString( mToIdentifierSuffix, QStringLiteral( "yyyy-MM-dd" ) );
+        const QDate next = date.addDays( step );
+        if ( !date.isValid() || ( next > QDate::currentDate() ) ||
+             ( to.isValid() && ( ( step > 0 ) ? ( next > to ) : ( next < to ) ) ) ) {
+            return QString();
+        }
+        return next.toString( QStringLiteral( "yyyy-MM-dd" ) );
+    } else if ( mIdentifierType == Number ) {
+        bool ok;
+        const int number = suffix.toInt( &ok );
+        bool toOk;
+        const int to = mToIdentifierSuffix.toInt( &toOk );
+        const int next = number + step;
+        if ( !ok || ( next < 1 ) || ( toOk && ( ( step > 0 ) ? ( next > to ) : ( next < to ) ) ) ) {
+            return QString();
         }
+        return QString::number( next );
     }
 
-    copyZipFileToDestination();
+    //String identifiers can only be followed by their links
+    return QString();
 }
 
-void ComicArchiveJob::copyZipFileToDestination()
+bool ComicArchiveJob::addImageToZip( const QImage &image, const QByteArray &imageData )
 {
-    mZip->close();
+    //store the strip as it was downloaded, only encode it if that is not known
+    QByteArray data = imageData;
+    QByteArray format;
+    if ( !data.isEmpty() ) {
+        QBuffer buffer( &data );
+        buffer.open( QIODevice::ReadOnly );
+        format = QImageReader::imageFormat( &buffer );
+    }
+    if ( format.isEmpty() ) {
+        data.clear();
+        QBuffer buffer( &data );
+        buffer.open( QIODevice::WriteOnly );
+        if ( !image.save( &buffer, "PNG" ) ) {
+            return false;
+        }
+        format = "png";
+    } else if ( format == "jpeg" ) {
+        format = "jpg";
+    }
 
-    KIO::FileCopyJob *job = KIO::file_copy( QUrl::fromLocalFile( mZipFile->fileName() ), mDest );
+    //backward the final position is not known yet, see renumberBackwardEntries
+    ++mComicNumber;
+    const int number = ( mDirection == Backward ? BACKWARD_BASE - mComicNumber : mComicNumber );
+    const QString name = entryNumber( number ) + QLatin1Char( '.' ) + QString::fromLatin1( format );
+    return mZip->writeFile( name, data );
+}
 
-    const bool worked = job->exec();
+void ComicArchiveJob::copyZipFileToDestination()
+{
+    if ( !mZip->close() ) {
+        qWarning() << "Could not finish the zip file.";
+        setErrorText( i18n( "Could not create the archive at the specified location." ) );
+        setError( KilledJobError );
+        emitResultIfNeeded();
+        return;
+    }
 
-    if (!worked) {
-        qWarning() << "Could not copy the zip file to the specified destination:" << mDest;
+    if ( ( mDirection == Backward ) && !renumberBackwardEntries( mZipFile->fileName(), mComicNumber ) ) {
+        qWarning() << "Could not renumber the strips of the zip file.";
         setErrorText( i18n( "Could not create the archive at the specified location." ) );
         setError( KilledJobError );
         emitResultIfNeeded();
         return;
     }
 
+    if ( mDest.isLocalFile() ) {
+        //QFile::rename does not replace an existing file, rename() does so atomically
+        const QString dest = mDest.toLocalFile();
+        if ( std::rename( QFile::encodeName( mZipFile->fileName() ).constData(), QFile::encodeName( dest ).constData() ) != 0 ) {
+            qWarning() << "Could not move the zip file to the specified destination:" << mDest;
+            setErrorText( i18n( "Could not create the archive at the specified location." ) );
+            setError( KilledJobError );
+        } else {
+            mZipFile->setAutoRemove( false );
+        }
+        emitResultIfNeeded();
+        return;
+    }
+
+    KIO::FileCopyJob *job = KIO::file_copy( QUrl::fromLocalFile( mZipFile->fileName() ), mDest );
+    connect( job, SIGNAL(result(KJob*)), this, SLOT(copyFinished(KJob*)) );
+}
+
+void ComicArchiveJob::copyFinished( KJob *job )
+{
+    if ( job->error() ) {
+        qWarning() << "Could not copy the zip file to the specified destination:" << mDest;
+        setErrorText( i18n( "Could not create the archive at the specified location." ) );
+        setError( KilledJobError );
+    }
+
     emitResultIfNeeded();
 }
 
@@ -400,6 +679,11 @@ void ComicArchiveJob::emitResultIfNeeded()
 {
     if ( !mDone ) {
         mDone = true;
+        for ( const QString &identifier : qAsConst( mInFlight ) ) {
+            mEngine->disconnectSource( identifier, this );
+        }
+        mInFlight.clear();
+        mReady.clear();
         emitResult();
     }
 }
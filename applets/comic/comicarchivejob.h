@@ -23,6 +23,8 @@
 
 #include "comicinfo.h"
 
+#include <QSet>
+
 #include <KIO/Job>
 #include <Plasma/DataEngine>
 
@@ -76,6 +78,10 @@ class ComicArchiveJob : public KJob
     public Q_SLOTS:
         void dataUpdated( const QString &source, const Plasma::DataEngine::Data& data );
 
+    private Q_SLOTS:
+        void processReady();
+        void copyFinished( KJob *job );
+
     protected:
         bool doKill() override;
         bool doSuspend() override;
@@ -96,16 +102,50 @@ class ComicArchiveJob : public KJob
          */
         void findTotalNumberFromTo();
 
+        /**
+         * Reads the strips the engine already knows about, so that the
+         * range can be planned without asking the website
+         */
+        void loadNavigation();
+
+        /**
+         * Returns the position of suffix in the known strips, -1 if it is not known
+         */
+        int knownPosition( const QString &suffix ) const;
+
+        /**
+         * The suffix the total number is calculated for, if the end is open
+         * the most recent known strip is used
+         */
+        QString totalToSuffix() const;
+
         QString suffixToIdentifier( const QString &suffix ) const;
+        void processStrip( const QString &source, const Plasma::DataEngine::Data &data );
         void requestComic( QString identifier );
-        bool addFileToZip( const QString &path );
+        void connectComic( const QString &identifier );
+
+        /**
+         * Requests the strips likely following mExpected in advance,
+         * up to a fixed number of strips are downloaded at once
+         */
+        void prefetch();
+
+        /**
+         * Guesses the suffix following suffix in the current direction,
+         * empty if there is no good guess or the end is reached
+         */
+        QString predictSuffix( const QString &suffix ) const;
+
+        /**
+         * Writes the strip to the zip, the downloaded imageData if its format
+         * is known, otherwise image encoded as PNG
+         */
+        bool addImageToZip( const QImage &image, const QByteArray &imageData );
 
         /**
-         * If the ArchiveDirection is Backward, this will fill the zip
-         * with mBackwardFiles (beginning from the back), and will call
-         * copyZipFileToDestination afterwards
+         * Finishes the zip, renumbers the strips if the ArchiveDirection is
+         * Backward and moves it to the destination if that is not local
          */
-        void createBackwardZip();
         void copyZipFileToDestination();
 
         void emitResultIfNeeded();
@@ -137,9 +177,15 @@ class ComicArchiveJob : public KJob
         QString mFromIdentifierSuffix;
         QString mComicTitle;
         QString mRequest;
+        QString mFirstKnownSuffix;
+        QString mLastKnownSuffix;
+        QHash< QString, int > mKnownPositions;
+        QStringList mKnownSuffixes;
+        QString mExpected;
+        QSet< QString > mInFlight;
+        QHash< QString, Plasma::DataEngine::Data > mReady;
         const QUrl mDest;
         QStringList mAuthors;
-        QList< QTemporaryFile* > mBackwardFiles;
 };
 
 #endif
@@ -124,6 +124,25 @@ void ComicData::setData(const Plasma::DataEngine::Data &data)
     save();
 }
 
+void ComicData::setNavigation(const Plasma::DataEngine::Data &navigation)
+{
+    mKnownStrips = navigation[QStringLiteral("Identifier suffixes")].toStringList();
+
+    if (mFirst.isEmpty()) {
+        mFirst = navigation[QStringLiteral("First strip identifier suffix")].toString();
+    }
+
+    if (mType == Number) {
+        const int last = navigation[QStringLiteral("Last strip identifier suffix")].toString().toInt();
+        if (mMaxStripNum < last) {
+            mMaxStripNum = last;
+        }
+        if (!mFirst.isEmpty()) {
+            mFirstStripNum = mFirst.toInt();
+        }
+    }
+}
+
 void ComicData::createErrorPicture(const Plasma::DataEngine::Data &data)
 {
     QPixmap errorPic( 500, 400 );
@@ -27,6 +27,7 @@
 #include <QUrl>
 #include <QImage>
 #include <QString>
+#include <QStringList>
 
 class ComicData
 {
@@ -37,6 +38,12 @@ class ComicData
 
         void setData(const Plasma::DataEngine::Data &data);
 
+        /**
+         * Uses the strips the engine knows about, i.e. the data of the
+         * "navigation:" source, to complete the range of the comic
+         */
+        void setNavigation(const Plasma::DataEngine::Data &navigation);
+
         IdentifierType type() const { return mType; }
 
         /**
@@ -73,6 +80,11 @@ class ComicData
          */
         QString first() const { return mFirst; }
 
+        /**
+         * All strips known to the engine, in their order
+         */
+        QStringList knownStrips() const { return mKnownStrips; }
+
         bool hasNext() const { return !mNext.isEmpty(); }
 
         bool hasPrev() const { return !mPrev.isEmpty(); }
@@ -131,6 +143,7 @@ class ComicData
         QString mPrev;
         QString mStored;
         QString mCurrentReadable;
+        QStringList mKnownStrips;
 
         QString mErrorStrip;
 
@@ -16,6 +16,7 @@
  */
 
 import QtQuick 2.1
+import QtQuick.Window 2.2
 import org.kde.plasma.core 2.0 as PlasmaCore
 import org.kde.plasma.components 2.0 as PlasmaComponents
 import org.kde.kquickcontrolsaddons 2.0
@@ -84,6 +85,12 @@ Item {
             isTopToBottom: plasmoid.nativeInterface.comicData.isTopToBottom
         }
 
+        Binding {
+            target: plasmoid.nativeInterface
+            property: "displaySize"
+            value: Qt.size(Math.round(comicImage.width * Screen.devicePixelRatio), Math.round(comicImage.height * Screen.devicePixelRatio))
+        }
+
         ButtonBar {
             id: buttonBar
 
@@ -139,6 +146,6 @@ Item {
     FullViewWidget {
         id: fullDialog
 
-        image: plasmoid.nativeInterface.comicData.image
+        image: plasmoid.nativeInterface.comicData.fullImage
     }
 }
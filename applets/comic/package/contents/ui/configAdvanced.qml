@@ -34,6 +34,7 @@ Kirigami.FormLayout {
     function saveConfig() {
         plasmoid.nativeInterface.showErrorPicture = showErrorPicture.checked;
         plasmoid.nativeInterface.maxComicLimit = maxComicLimit.value;
+        plasmoid.nativeInterface.prefetchDepth = prefetchDepth.value;
 
         plasmoid.nativeInterface.saveConfig();
         plasmoid.nativeInterface.configChanged();
@@ -42,6 +43,7 @@ Kirigami.FormLayout {
     Component.onCompleted: {
         showErrorPicture.checked = plasmoid.nativeInterface.showErrorPicture;
         maxComicLimit.value = plasmoid.nativeInterface.maxComicLimit;
+        prefetchDepth.value = plasmoid.nativeInterface.prefetchDepth;
     }
 
     Layouts.RowLayout {
@@ -58,6 +60,21 @@ Kirigami.FormLayout {
         }
     }
 
+    Layouts.RowLayout {
+        Kirigami.FormData.label: i18nc("@label:spinbox", "Read ahead:")
+
+        Controls.SpinBox {
+            id: prefetchDepth
+            stepSize: 1
+            to: 20
+            onValueChanged: root.configurationChanged();
+        }
+
+        Controls.Label {
+            text: i18ncp("@item:valuesuffix spacing to number + unit", "strip in each direction", "strips in each direction")
+        }
+    }
+
     Controls.CheckBox {
         id: showErrorPicture
         text: i18nc("@option:check", "Display error when downloading comic fails")
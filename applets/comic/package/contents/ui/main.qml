@@ -30,15 +30,15 @@ Item {
     readonly property int implicitHeight: units.gridUnit * 15
     Plasmoid.backgroundHints: PlasmaCore.Types.DefaultBackground | PlasmaCore.Types.ConfigurableBackground
     Plasmoid.switchWidth: {
-        if (centerLayout.comicData.image) {
-            return Math.max(minimumWidth, Math.min(centerLayout.comicData.image.nativeWidth * 0.6, implicitWidth));
+        if (centerLayout.comicData.fullImage) {
+            return Math.max(minimumWidth, Math.min(centerLayout.comicData.fullImage.nativeWidth * 0.6, implicitWidth));
         } else {
             return units.gridUnit * 8;
         }
     }
     Plasmoid.switchHeight: {
-        if (centerLayout.comicData.image) {
-            return Math.max(minimumHeight, Math.min(centerLayout.comicData.image.nativeHeight * 0.6, implicitHeight));
+        if (centerLayout.comicData.fullImage) {
+            return Math.max(minimumHeight, Math.min(centerLayout.comicData.fullImage.nativeHeight * 0.6, implicitHeight));
         } else {
             return units.gridUnit * 8;
         }
@@ -111,9 +111,18 @@ StringStripSelector::~StringStripSelector()
 void StringStripSelector::select(const ComicData &currentStrip)
 {
     bool ok;
-    const QString strip = QInputDialog::getText(nullptr, i18nc("@title:window", "Go to Strip"),
-                                                i18nc("@label:textbox", "Strip identifier:"), QLineEdit::Normal,
-                                                 currentStrip.current(), &ok);
+    QString strip;
+    const QStringList knownStrips = currentStrip.knownStrips();
+    if (knownStrips.isEmpty()) {
+        strip = QInputDialog::getText(nullptr, i18nc("@title:window", "Go to Strip"),
+                                      i18nc("@label:textbox", "Strip identifier:"), QLineEdit::Normal,
+                                      currentStrip.current(), &ok);
+    } else {
+        //offer the strips the engine knows about, other identifiers can still be typed in
+        strip = QInputDialog::getItem(nullptr, i18nc("@title:window", "Go to Strip"),
+                                      i18nc("@label:textbox", "Strip identifier:"), knownStrips,
+                                      qMax(knownStrips.indexOf(currentStrip.current()), 0), true, &ok);
+    }
     if (ok) {
         emit stripChosen(strip);
     }
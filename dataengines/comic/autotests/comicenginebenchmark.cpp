@@ -0,0 +1,420 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QBuffer>
+#include <QColor>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QImage>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTest>
+#include <QTimer>
+
+#include <Plasma/DataEngine>
+
+#include "../comic.h"
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// the most recent strip served, strips are numbered from 1
+static const int LAST_STRIP = 600;
+static const int NAVIGATION_STRIPS = 50;
+static const int ARCHIVE_STRIPS = 500;
+static const int ARCHIVE_PIPELINE = 4;
+static const int TABS = 20;
+static const int COLD_RUNS = 10;
+static const int TIMEOUT = 30000;
+
+/**
+ * Serves recorded-like strips of a Number comic over HTTP, /strip/ is the
+ * most recent one, /strip/<n> the others and /image/<n>.png their images.
+ * COMIC_BENCHMARK_DELAY adds a delay in milliseconds to each response.
+ */
+class StripServer : public QTcpServer
+{
+    Q_OBJECT
+
+    public:
+        StripServer()
+            : mDelay(qEnvironmentVariableIntValue("COMIC_BENCHMARK_DELAY"))
+        {
+            //strips are usually a few hundred KiB, some shades make sure PNG cannot compress them away
+            const QColor colors[] = { Qt::red, Qt::green, Qt::blue, Qt::yellow };
+            for (const QColor &color : colors) {
+                QImage image(1200, 400, QImage::Format_RGB32);
+                for (int y = 0; y < image.height(); ++y) {
+                    for (int x = 0; x < image.width(); ++x) {
+                        image.setPixel(x, y, color.darker(100 + (x * y) % 97).rgb());
+                    }
+                }
+                QByteArray data;
+                QBuffer buffer(&data);
+                buffer.open(QIODevice::WriteOnly);
+                image.save(&buffer, "PNG");
+                mImages << data;
+            }
+        }
+
+    protected:
+        void incomingConnection(qintptr descriptor) override
+        {
+            QTcpSocket *socket = new QTcpSocket(this);
+            socket->setSocketDescriptor(descriptor);
+            connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
+                mRequests[socket] += socket->readAll();
+                if (!mRequests[socket].contains("\r\n\r\n")) {
+                    return;
+                }
+                const QByteArray path = mRequests.take(socket).split(' ').value(1);
+                QTimer::singleShot(mDelay, socket, [this, socket, path]() {
+                    respond(socket, path);
+                });
+            });
+            connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        }
+
+    private:
+        void respond(QTcpSocket *socket, const QByteArray &path)
+        {
+            QByteArray type = "text/html";
+            QByteArray body;
+            if (path.startsWith("/strip/")) {
+                const int strip = path.mid(7).isEmpty() ? LAST_STRIP : path.mid(7).toInt();
+                body = QStringLiteral("<html><head><title>Strip %1</title></head><body>"
+                                      "<h1>Strip %1</h1><div class=\"strip\" data-id=\"%1\" data-last=\"%2\">"
+                                      "<img src=\"/image/%1.png\" alt=\"Strip %1\"></div></body></html>")
+                                      .arg(strip).arg(LAST_STRIP).toUtf8();
+            } else if (path.startsWith("/image/")) {
+                type = "image/png";
+                body = mImages.at(path.mid(7).split('.').value(0).toInt() % mImages.size());
+            }
+
+            QByteArray response = body.isEmpty() ? "HTTP/1.1 404 Not Found\r\n" : "HTTP/1.1 200 OK\r\n";
+            response += "Content-Type: " + type + "\r\nContent-Length: " + QByteArray::number(body.size())
+                        + "\r\nConnection: close\r\n\r\n" + body;
+            socket->write(response);
+            socket->disconnectFromHost();
+        }
+
+        int mDelay;
+        QVector<QByteArray> mImages;
+        QHash<QTcpSocket*, QByteArray> mRequests;
+};
+
+/**
+ * Passes the updates of the engine on as a signal.
+ */
+class Receiver : public QObject
+{
+    Q_OBJECT
+
+    public Q_SLOTS:
+        void dataUpdated(const QString &source, const Plasma::DataEngine::Data &data)
+        {
+            emit received(source, data);
+        }
+
+    Q_SIGNALS:
+        void received(const QString &source, const Plasma::DataEngine::Data &data);
+};
+
+/**
+ * The strips come from the local server, the state of the network does not matter
+ */
+class OnlineComicEngine : public ComicEngine
+{
+    public:
+        using ComicEngine::ComicEngine;
+
+    protected:
+        bool isOnline() const override
+        {
+            return true;
+        }
+};
+
+/**
+ * Drives the comic engine through the workloads of the applet against a
+ * local HTTP server and reports latency percentiles, CPU time and peak memory.
+ */
+class ComicEngineBenchmark : public QObject
+{
+    Q_OBJECT
+
+    private Q_SLOTS:
+        void initTestCase();
+        void cleanupTestCase();
+
+        void coldCurrentStrip();
+        void cachedNavigation();
+        void archive();
+        void newStripCheck();
+
+    private:
+        void installPackage(const QString &name, bool declarative);
+        QHash<QString, qint64> requestAll(const QStringList &sources, int pipeline, const QString &priority = QString());
+        void report(const QString &workload, QVector<qint64> latencies, qint64 wallTime, qint64 cpuTime);
+        static qint64 cpuTime();
+        static qint64 peakMemory();
+
+        StripServer mServer;
+        Receiver mReceiver;
+        ComicEngine *mEngine = nullptr;
+        QString mBaseUrl;
+};
+
+void ComicEngineBenchmark::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QVERIFY(mServer.listen(QHostAddress::LocalHost));
+    mBaseUrl = QStringLiteral("http://127.0.0.1:%1").arg(mServer.serverPort());
+
+    //start from an empty cache with only the sample comics installed
+    const QString data = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation);
+    QDir(data + QLatin1String("/plasma_engine_comic")).removeRecursively();
+    QDir(data + QLatin1String("/plasma/comics")).removeRecursively();
+    installPackage(QStringLiteral("benchkross"), false);
+    for (int i = 0; i <= TABS; ++i) {
+        installPackage(QStringLiteral("benchjson%1").arg(i, 2, 10, QLatin1Char('0')), true);
+    }
+
+    mEngine = new OnlineComicEngine(this, QVariantList());
+}
+
+void ComicEngineBenchmark::cleanupTestCase()
+{
+    delete mEngine;
+    qInfo() << "peak memory" << peakMemory() << "KiB";
+}
+
+void ComicEngineBenchmark::installPackage(const QString &name, bool declarative)
+{
+    const QString path = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma/comics/") + name;
+    QVERIFY(QDir().mkpath(path + QLatin1String("/contents/code")));
+
+    QFile metadata(path + QLatin1String("/metadata.desktop"));
+    QVERIFY(metadata.open(QIODevice::WriteOnly));
+    metadata.write(QStringLiteral("[Desktop Entry]\n"
+                                  "Name=%1\n"
+                                  "Type=Service\n"
+                                  "X-KDE-ServiceTypes=Plasma/Comic\n"
+                                  "X-KDE-PluginInfo-Name=%1\n"
+                                  "X-KDE-PluginInfo-EnabledByDefault=true\n"
+                                  "X-KDE-PlasmaComicProvider-SuffixType=Number\n").arg(name).toUtf8());
+
+    QFile script(path + (declarative ? QLatin1String("/contents/code/main.json") : QLatin1String("/contents/code/main.es")));
+    QVERIFY(script.open(QIODevice::WriteOnly));
+    if (declarative) {
+        script.write(QStringLiteral("{\n"
+                                    "    \"websiteUrl\": \"%1/strip/%{identifier}\",\n"
+                                    "    \"currentUrl\": \"%1/strip/\",\n"
+                                    "    \"author\": \"Benchmark\",\n"
+                                    "    \"rules\": {\n"
+                                    "        \"identifier\": \"data-id=\\\"(\\\\d+)\\\"\",\n"
+                                    "        \"image\": \"<img src=\\\"([^\\\"]+)\\\"\",\n"
+                                    "        \"title\": \"<h1>([^<]*)</h1>\"\n"
+                                    "    }\n"
+                                    "}\n").arg(mBaseUrl).toUtf8());
+    } else {
+        script.write(QStringLiteral("function init()\n"
+                                    "{\n"
+                                    "    comic.comicAuthor = \"Benchmark\";\n"
+                                    "    comic.firstIdentifier = 1;\n"
+                                    "    comic.websiteUrl = \"%1/strip/\" + (comic.identifierSpecified ? comic.identifier : \"\");\n"
+                                    "    comic.requestPage(comic.websiteUrl, comic.User);\n"
+                                    "}\n"
+                                    "\n"
+                                    "function pageRetrieved(id, data)\n"
+                                    "{\n"
+                                    "    if (id == comic.User) {\n"
+                                    "        comic.lastIdentifier = /data-last=\"(\\d+)\"/.exec(data)[1];\n"
+                                    "        comic.identifier = /data-id=\"(\\d+)\"/.exec(data)[1];\n"
+                                    "        comic.title = /<h1>([^<]*)<\\/h1>/.exec(data)[1];\n"
+                                    "        comic.requestPage(\"%1\" + /<img src=\"([^\"]+)\"/.exec(data)[1], comic.Image);\n"
+                                    "    }\n"
+                                    "}\n").arg(mBaseUrl).toUtf8());
+    }
+}
+
+QHash<QString, qint64> ComicEngineBenchmark::requestAll(const QStringList &sources, int pipeline, const QString &priority)
+{
+    //like the applet, sources are disconnected once their strip arrived,
+    //failed requests are left out of the result
+    QHash<QString, qint64> latencies;
+    QSet<QString> failed;
+    QHash<QString, QElapsedTimer> started;
+    int next = 0;
+    QEventLoop loop;
+    auto startNext = [&]() {
+        while (next < sources.count() && started.count() - latencies.count() - failed.count() < pipeline) {
+            const QString source = sources.at(next++);
+            started[source].start();
+            if (!priority.isEmpty()) {
+                mEngine->query(QLatin1String("setting_priority:") + priority + QLatin1Char(':') + source);
+            }
+            mEngine->connectSource(source, &mReceiver);
+        }
+        if (latencies.count() + failed.count() == sources.count()) {
+            loop.quit();
+        }
+    };
+    const QMetaObject::Connection connection = connect(&mReceiver, &Receiver::received, this,
+        [&](const QString &source, const Plasma::DataEngine::Data &data) {
+            if (!started.contains(source) || latencies.contains(source) || failed.contains(source)) {
+                return;
+            }
+            if (data.value(QStringLiteral("Error")).toBool()) {
+                qWarning() << source << "failed";
+                failed.insert(source);
+            } else if (data.value(QStringLiteral("Image")).isNull()) {
+                return;
+            } else {
+                latencies[source] = started[source].elapsed();
+            }
+            mEngine->disconnectSource(source, &mReceiver);
+            QTimer::singleShot(0, &loop, startNext);
+        });
+
+    QTimer::singleShot(0, &loop, startNext);
+    QTimer::singleShot(TIMEOUT + sources.count() * 1000, &loop, &QEventLoop::quit);
+    loop.exec();
+    disconnect(connection);
+
+    if (latencies.count() + failed.count() != sources.count()) {
+        qWarning() << sources.count() - latencies.count() - failed.count() << "requests did not finish in time";
+    }
+    return latencies;
+}
+
+void ComicEngineBenchmark::report(const QString &workload, QVector<qint64> latencies, qint64 wallTime, qint64 cpuTime)
+{
+    QVERIFY(!latencies.isEmpty());
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](int p) {
+        return latencies.at(qMin(latencies.count() - 1, latencies.count() * p / 100));
+    };
+    qInfo().noquote() << QStringLiteral("%1: %2 requests, p50 %3 ms, p90 %4 ms, p99 %5 ms, max %6 ms, wall %7 ms, cpu %8 ms, peak memory %9 KiB")
+                         .arg(workload).arg(latencies.count()).arg(percentile(50)).arg(percentile(90)).arg(percentile(99))
+                         .arg(latencies.last()).arg(wallTime).arg(cpuTime).arg(peakMemory());
+}
+
+qint64 ComicEngineBenchmark::cpuTime()
+{
+#ifdef Q_OS_UNIX
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+#else
+    return 0;
+#endif
+}
+
+qint64 ComicEngineBenchmark::peakMemory()
+{
+#ifdef Q_OS_UNIX
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+void ComicEngineBenchmark::coldCurrentStrip()
+{
+    //the most recent strip is never cached, it is always looked up on the website
+    const QStringList comics = QStringList() << QStringLiteral("benchjson00") << QStringLiteral("benchkross");
+    for (const QString &comic : comics) {
+        QVector<qint64> latencies;
+        QElapsedTimer wall;
+        wall.start();
+        const qint64 cpu = cpuTime();
+        for (int i = 0; i < COLD_RUNS; ++i) {
+            latencies += requestAll(QStringList() << comic + QLatin1Char(':'), 1).values().toVector();
+            //otherwise the next run gets the data that is still there
+            QTRY_VERIFY_WITH_TIMEOUT(!mEngine->sources().contains(comic + QLatin1Char(':')), TIMEOUT);
+        }
+        if (latencies.isEmpty()) {
+            qWarning() << comic << "did not deliver any strip, is its interpreter installed?";
+            continue;
+        }
+        report(QStringLiteral("cold current strip (%1)").arg(comic), latencies, wall.elapsed(), cpuTime() - cpu);
+    }
+}
+
+void ComicEngineBenchmark::cachedNavigation()
+{
+    QStringList sources;
+    for (int i = 1; i <= NAVIGATION_STRIPS; ++i) {
+        sources << QStringLiteral("benchjson00:%1").arg(i);
+    }
+
+    //the first pass fills the cache, stepping through it again is what is measured
+    QCOMPARE(requestAll(sources, 1).count(), sources.count());
+    QElapsedTimer wall;
+    wall.start();
+    const qint64 cpu = cpuTime();
+    const QVector<qint64> latencies = requestAll(sources, 1).values().toVector();
+    QCOMPARE(latencies.count(), sources.count());
+    report(QStringLiteral("cached navigation"), latencies, wall.elapsed(), cpuTime() - cpu);
+}
+
+void ComicEngineBenchmark::archive()
+{
+    //like the archive job, a few strips ahead are requested while the others arrive
+    QStringList sources;
+    for (int i = NAVIGATION_STRIPS + 1; i <= NAVIGATION_STRIPS + ARCHIVE_STRIPS; ++i) {
+        sources << QStringLiteral("benchjson00:%1").arg(i);
+    }
+
+    QElapsedTimer wall;
+    wall.start();
+    const qint64 cpu = cpuTime();
+    const QVector<qint64> latencies = requestAll(sources, ARCHIVE_PIPELINE, QStringLiteral("archive")).values().toVector();
+    QCOMPARE(latencies.count(), sources.count());
+    report(QStringLiteral("archive"), latencies, wall.elapsed(), cpuTime() - cpu);
+}
+
+void ComicEngineBenchmark::newStripCheck()
+{
+    //every tab asks for its most recent strip at once
+    QStringList sources;
+    for (int i = 1; i <= TABS; ++i) {
+        sources << QStringLiteral("benchjson%1:").arg(i, 2, 10, QLatin1Char('0'));
+    }
+
+    QElapsedTimer wall;
+    wall.start();
+    const qint64 cpu = cpuTime();
+    const QVector<qint64> latencies = requestAll(sources, TABS).values().toVector();
+    QCOMPARE(latencies.count(), sources.count());
+    report(QStringLiteral("new strip check"), latencies, wall.elapsed(), cpuTime() - cpu);
+}
+
+QTEST_MAIN(ComicEngineBenchmark)
+
+#include "comicenginebenchmark.moc"
@@ -0,0 +1,233 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QBuffer>
+#include <QColor>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QImage>
+#include <QSignalSpy>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QUrl>
+
+#include "../comicproviderjson.h"
+
+static const int TIMEOUT = 10000;
+
+/**
+ * Runs the sample manifests in data/comicproviderjson against their fixture
+ * pages, which are served as local files. The images referenced by the pages
+ * are created by the test, each one in its own color.
+ */
+class ComicProviderJsonTest : public QObject
+{
+    Q_OBJECT
+
+    private Q_SLOTS:
+        void initTestCase();
+        void testNumberStrip();
+        void testCurrentNumberStrip();
+        void testRememberedLastNumber();
+        void testStringStrip_data();
+        void testStringStrip();
+        void testCurrentStringStrip();
+        void testDateStrip();
+
+    private:
+        void installComic(const QString &name, const QStringList &images);
+        ComicProviderJson *request(const QString &name, const QString &type, const QVariant &requested, bool isCurrent);
+        static bool run(ComicProvider *provider);
+
+        QTemporaryDir mDir;
+        QHash<QString, QByteArray> mImages;
+};
+
+void ComicProviderJsonTest::initTestCase()
+{
+    QStandardPaths::setTestModeEnabled(true);
+    QVERIFY(mDir.isValid());
+
+    installComic(QStringLiteral("numbers"), QStringList() << QStringLiteral("logo") << QStringLiteral("1") << QStringLiteral("2") << QStringLiteral("3"));
+    installComic(QStringLiteral("strings"), QStringList() << QStringLiteral("first") << QStringLiteral("middle") << QStringLiteral("last"));
+    installComic(QStringLiteral("dates"), QStringList() << QStringLiteral("20200115"));
+}
+
+void ComicProviderJsonTest::installComic(const QString &name, const QStringList &images)
+{
+    const QString source = QFINDTESTDATA(QLatin1String("data/comicproviderjson/") + name);
+    QVERIFY(!source.isEmpty());
+    const QString path = mDir.path() + QLatin1Char('/') + name;
+    QVERIFY(QDir().mkpath(path + QLatin1String("/pages/images")));
+
+    QVERIFY(QFile::copy(source + QLatin1String("/metadata.desktop"), path + QLatin1String("/metadata.desktop")));
+    const QStringList pages = QDir(source + QLatin1String("/pages")).entryList(QDir::Files);
+    for (const QString &page : pages) {
+        QVERIFY(QFile::copy(source + QLatin1String("/pages/") + page, path + QLatin1String("/pages/") + page));
+    }
+
+    //the urls of the manifest point to the copied pages
+    QFile templateFile(source + QLatin1String("/main.json"));
+    QVERIFY(templateFile.open(QIODevice::ReadOnly));
+    QFile manifest(path + QLatin1String("/main.json"));
+    QVERIFY(manifest.open(QIODevice::WriteOnly));
+    manifest.write(templateFile.readAll().replace("@PAGES@", QUrl::fromLocalFile(path + QLatin1String("/pages")).toEncoded()));
+
+    for (int i = 0; i < images.count(); ++i) {
+        QImage image(40, 20, QImage::Format_RGB32);
+        image.fill(QColor::fromHsv(i * 60, 255, 255));
+        QByteArray data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::WriteOnly);
+        QVERIFY(image.save(&buffer, "PNG"));
+
+        QFile file(path + QLatin1String("/pages/images/") + images[i] + QLatin1String(".png"));
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+        mImages.insert(name + QLatin1Char('/') + images[i], data);
+    }
+}
+
+ComicProviderJson *ComicProviderJsonTest::request(const QString &name, const QString &type, const QVariant &requested, bool isCurrent)
+{
+    const QString path = mDir.path() + QLatin1Char('/') + name;
+    QVariantList args;
+    args << type << requested << (path + QLatin1String("/metadata.desktop")) << (path + QLatin1String("/main.json"));
+    ComicProviderJson *provider = new ComicProviderJson(nullptr, args);
+    provider->setIsCurrent(isCurrent);
+    return provider;
+}
+
+bool ComicProviderJsonTest::run(ComicProvider *provider)
+{
+    QSignalSpy finished(provider, SIGNAL(finished(ComicProvider*)));
+    QSignalSpy error(provider, SIGNAL(error(ComicProvider*)));
+    QTest::qWaitFor([&finished, &error]() {
+        return !finished.isEmpty() || !error.isEmpty();
+    }, TIMEOUT);
+    return !finished.isEmpty();
+}
+
+void ComicProviderJsonTest::testNumberStrip()
+{
+    //nothing is known about the comic yet, so the page of the most recent strip is read as well
+    QScopedPointer<ComicProviderJson> provider(request(QStringLiteral("numbers"), QStringLiteral("Number"), 2, false));
+    QVERIFY(run(provider.data()));
+
+    QCOMPARE(provider->identifier(), QStringLiteral("jsonnumbers:2"));
+    QCOMPARE(provider->imageData(), mImages.value(QStringLiteral("numbers/2")));
+    QVERIFY(!provider->image().isNull());
+    QCOMPARE(provider->stripTitle(), QStringLiteral("Strip 2"));
+    QCOMPARE(provider->additionalText(), QStringLiteral("Tom & Jerry, part 2"));
+    QCOMPARE(provider->comicAuthor(), QStringLiteral("Sample Author"));
+    QCOMPARE(provider->previousIdentifier(), QStringLiteral("1"));
+    QCOMPARE(provider->nextIdentifier(), QStringLiteral("3"));
+    QCOMPARE(provider->firstStripIdentifier(), QStringLiteral("1"));
+    QCOMPARE(provider->websiteUrl().fileName(), QStringLiteral("2.html"));
+}
+
+void ComicProviderJsonTest::testCurrentNumberStrip()
+{
+    QScopedPointer<ComicProviderJson> provider(request(QStringLiteral("numbers"), QStringLiteral("Number"), 0, true));
+    QVERIFY(run(provider.data()));
+
+    QCOMPARE(provider->identifier(), QStringLiteral("jsonnumbers:3"));
+    QCOMPARE(provider->imageData(), mImages.value(QStringLiteral("numbers/3")));
+    QCOMPARE(provider->previousIdentifier(), QStringLiteral("2"));
+    QVERIFY(provider->nextIdentifier().isEmpty());
+}
+
+void ComicProviderJsonTest::testRememberedLastNumber()
+{
+    //the most recent strip is known from the previous tests, its page must not be needed anymore
+    QVERIFY(QFile::remove(mDir.path() + QLatin1String("/numbers/pages/index.html")));
+
+    QScopedPointer<ComicProviderJson> provider(request(QStringLiteral("numbers"), QStringLiteral("Number"), 3, false));
+    QVERIFY(run(provider.data()));
+
+    QCOMPARE(provider->identifier(), QStringLiteral("jsonnumbers:3"));
+    QCOMPARE(provider->previousIdentifier(), QStringLiteral("2"));
+    QVERIFY(provider->nextIdentifier().isEmpty());
+
+    provider.reset(request(QStringLiteral("numbers"), QStringLiteral("Number"), 1, false));
+    QVERIFY(run(provider.data()));
+    QCOMPARE(provider->imageData(), mImages.value(QStringLiteral("numbers/1")));
+    QVERIFY(provider->previousIdentifier().isEmpty());
+    QCOMPARE(provider->nextIdentifier(), QStringLiteral("2"));
+}
+
+void ComicProviderJsonTest::testStringStrip_data()
+{
+    QTest::addColumn<QString>("suffix");
+    QTest::addColumn<QString>("previous");
+    QTest::addColumn<QString>("next");
+
+    QTest::newRow("first") << QStringLiteral("first") << QString() << QStringLiteral("middle");
+    QTest::newRow("middle") << QStringLiteral("middle") << QStringLiteral("first") << QStringLiteral("last");
+    QTest::newRow("last") << QStringLiteral("last") << QStringLiteral("middle") << QString();
+}
+
+void ComicProviderJsonTest::testStringStrip()
+{
+    QFETCH(QString, suffix);
+    QFETCH(QString, previous);
+    QFETCH(QString, next);
+
+    QScopedPointer<ComicProviderJson> provider(request(QStringLiteral("strings"), QStringLiteral("String"), suffix, false));
+    QVERIFY(run(provider.data()));
+
+    QCOMPARE(provider->identifier(), QStringLiteral("jsonstrings:") + suffix);
+    QCOMPARE(provider->imageData(), mImages.value(QStringLiteral("strings/") + suffix));
+    QCOMPARE(provider->stripTitle(), QStringLiteral("The %1 one").arg(suffix));
+    QCOMPARE(provider->previousIdentifier(), previous);
+    QCOMPARE(provider->nextIdentifier(), next);
+    QCOMPARE(provider->firstStripIdentifier(), QStringLiteral("first"));
+    QVERIFY(!provider->isLeftToRight());
+    QVERIFY(provider->isTopToBottom());
+}
+
+void ComicProviderJsonTest::testCurrentStringStrip()
+{
+    QScopedPointer<ComicProviderJson> provider(request(QStringLiteral("strings"), QStringLiteral("String"), QString(), true));
+    QVERIFY(run(provider.data()));
+
+    QCOMPARE(provider->identifier(), QStringLiteral("jsonstrings:last"));
+    QCOMPARE(provider->imageData(), mImages.value(QStringLiteral("strings/last")));
+    QCOMPARE(provider->previousIdentifier(), QStringLiteral("middle"));
+    QVERIFY(provider->nextIdentifier().isEmpty());
+}
+
+void ComicProviderJsonTest::testDateStrip()
+{
+    //strips appear on Monday, Wednesday and Friday, the url has the date without dashes
+    QScopedPointer<ComicProviderJson> provider(request(QStringLiteral("dates"), QStringLiteral("Date"), QDate(2020, 1, 15), false));
+    QVERIFY(run(provider.data()));
+
+    QCOMPARE(provider->identifier(), QStringLiteral("jsondates:2020-01-15"));
+    QCOMPARE(provider->imageData(), mImages.value(QStringLiteral("dates/20200115")));
+    QCOMPARE(provider->websiteUrl().fileName(), QStringLiteral("20200115.html"));
+    QCOMPARE(provider->previousIdentifier(), QStringLiteral("2020-01-13"));
+    QCOMPARE(provider->nextIdentifier(), QStringLiteral("2020-01-17"));
+    QCOMPARE(provider->firstStripIdentifier(), QStringLiteral("2020-01-01"));
+}
+
+QTEST_MAIN(ComicProviderJsonTest)
+
+#include "comicproviderjsontest.moc"
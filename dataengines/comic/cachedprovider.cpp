@@ -17,30 +17,83 @@
  */
 
 #include "cachedprovider.h"
+#include "comiccache.h"
 
 #include <QDir>
 #include <QFile>
-#include <QSettings>
-#include <QTimer>
-#include <QImage>
-#include <QDebug>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QSaveFile>
+#include <QThreadPool>
 #include <QUrl>
-#include <QStandardPaths>
+#include <QDebug>
 
-const int CachedProvider::CACHE_DEFAULT = 20;
+LoadImageThread::LoadImageThread(const QString &filePath)
+    : mFilePath(filePath)
+{
+}
 
-static QString identifierToPath(const QString &identifier)
+void LoadImageThread::run()
 {
-    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/");
+    //the file has the bytes as they were downloaded
+    QByteArray data;
+    QFile file(mFilePath);
+    if (file.open(QIODevice::ReadOnly)) {
+        data = file.readAll();
+    }
+    emit done(QImage::fromData(data), data);
+}
 
-    return dataDir + QString::fromLatin1(QUrl::toPercentEncoding(identifier));
+ScaleImageThread::ScaleImageThread(const QImage &image, const QString &filePath, const QString &variantPath, int width)
+    : mImage(image),
+      mFilePath(filePath),
+      mVariantPath(variantPath),
+      mWidth(width)
+{
 }
 
+void ScaleImageThread::run()
+{
+    QImage scaled;
+    if (!mVariantPath.isEmpty() && scaled.load(mVariantPath)) {
+        emit done(scaled);
+        return;
+    }
+
+    if (!mImage.isNull()) {
+        scaled = (mImage.width() > mWidth ? mImage.scaledToWidth(mWidth, Qt::SmoothTransformation) : mImage);
+    } else {
+        //lets e.g. jpeg decode right at the smaller size
+        QImageReader reader(mFilePath);
+        const QSize size = reader.size();
+        if (size.isValid() && size.width() > mWidth) {
+            reader.setScaledSize(QSize(mWidth, qMax(1, size.height() * mWidth / size.width())));
+        }
+        scaled = reader.read();
+    }
+
+    //strips narrower than the variant are shown as they are
+    if (!scaled.isNull() && !mVariantPath.isEmpty() && scaled.width() == mWidth) {
+        QDir().mkpath(QFileInfo(mVariantPath).path());
+        QSaveFile file(mVariantPath);
+        if (!file.open(QIODevice::WriteOnly) || !scaled.save(&file, "PNG") || !file.commit()) {
+            qWarning() << "Could not store the scaled image" << mVariantPath;
+        }
+    }
+    emit done(scaled);
+}
 
 CachedProvider::CachedProvider(QObject *parent, const QVariantList &args)
     : ComicProvider(parent, args)
 {
-    QTimer::singleShot(0, this, SLOT(triggerFinished()));
+    //read everything once, all getters are answered from memory
+    mStripInfo = ComicCache::self()->stripInfo(requestedString());
+    mComicInfo = ComicCache::self()->comicInfo(requestedComicName());
+    ComicCache::self()->touch(requestedString());
+
+    LoadImageThread *thread = new LoadImageThread(ComicCache::self()->imagePath(requestedString()));
+    connect(thread, SIGNAL(done(QImage,QByteArray)), this, SLOT(triggerFinished(QImage,QByteArray)));
+    QThreadPool::globalInstance()->start(thread);
 }
 
 CachedProvider::~CachedProvider()
@@ -54,13 +107,12 @@ ComicProvider::IdentifierType CachedProvider::identifierType() const
 
 QImage CachedProvider::image() const
 {
-    if (!QFile::exists(identifierToPath(requestedString())))
-        return QImage();
-
-    QImage img;
-    img.load(identifierToPath(requestedString()), "PNG");
+    return mImage;
+}
 
-    return img;
+QByteArray CachedProvider::imageData() const
+{
+    return mImageData;
 }
 
 QString CachedProvider::identifier() const
@@ -70,174 +122,97 @@ QString CachedProvider::identifier() const
 
 QString CachedProvider::nextIdentifier() const
 {
-    QSettings settings(identifierToPath(requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("nextIdentifier"), QString()).toString();
+    return mStripInfo.value(QLatin1String("nextIdentifier"));
 }
 
 QString CachedProvider::previousIdentifier() const
 {
-    QSettings settings(identifierToPath(requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("previousIdentifier"), QString()).toString();
+    return mStripInfo.value(QLatin1String("previousIdentifier"));
 }
 
 QString CachedProvider::firstStripIdentifier() const
 {
-    QSettings settings(identifierToPath(requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("firstStripIdentifier"), QString()).toString();
+    return mComicInfo.value(QLatin1String("firstStripIdentifier"));
 }
 
 QString CachedProvider::lastCachedStripIdentifier() const
 {
-    QSettings settings(identifierToPath(requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("lastCachedStripIdentifier"), QString()).toString();
+    return mComicInfo.value(QLatin1String("lastCachedStripIdentifier"));
 }
 
 QString CachedProvider::comicAuthor() const
 {
-    QSettings settings(identifierToPath(requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("comicAuthor"), QString()).toString();
+    return mStripInfo.value(QLatin1String("comicAuthor"));
 }
 
 QString CachedProvider::stripTitle() const
 {
-    QSettings settings(identifierToPath (requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("stripTitle"), QString()).toString();
+    return mStripInfo.value(QLatin1String("stripTitle"));
 }
 
 QString CachedProvider::additionalText() const
 {
-    QSettings settings(identifierToPath (requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("additionalText"), QString()).toString();
+    return mStripInfo.value(QLatin1String("additionalText"));
 }
 
 QString CachedProvider::suffixType() const
 {
-    QSettings settings(identifierToPath (requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("suffixType"), QString()).toString();
+    return mComicInfo.value(QLatin1String("suffixType"));
 }
 
 QString CachedProvider::name() const
 {
-    QSettings settings(identifierToPath (requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("title"), QString()).toString();
+    return mComicInfo.value(QLatin1String("title"));
 }
 
-void CachedProvider::triggerFinished()
+void CachedProvider::triggerFinished(const QImage &image, const QByteArray &data)
 {
+    mImage = image;
+    mImageData = data;
     emit finished(this);
 }
 
 bool CachedProvider::isCached(const QString &identifier)
 {
-    return QFile::exists(identifierToPath(identifier));
+    return ComicCache::self()->contains(identifier);
 }
 
-bool CachedProvider::storeInCache(const QString &identifier, const QImage &comic, const Settings &info)
+bool CachedProvider::storeInCache(const QString &identifier, const QImage &comic, const Settings &info, const QByteArray &data)
 {
-    const QString path = identifierToPath(identifier);
-
-    int index = identifier.indexOf(QLatin1Char(':'));
-    const QString comicName = identifier.mid(0, index);
-    const QString pathMain = identifierToPath(comicName);
-    const QString dirPath = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/") ;
-
-    if (!info.isEmpty()) {
-        QSettings settings(path + QLatin1String(".conf"), QSettings::IniFormat);
-        QSettings settingsMain(pathMain + QLatin1String(".conf"), QSettings::IniFormat);
-
-        for (Settings::const_iterator i = info.constBegin(); i != info.constEnd(); ++i) {
-                if ((i.key() == QLatin1String("firstStripIdentifier")) || (i.key() == QLatin1String("title")) ||
-                     (i.key() == QLatin1String("lastCachedStripIdentifier")) || (i.key() == QLatin1String("suffixType")) ||
-                     (i.key() == QLatin1String("shopUrl")) || (i.key() == QLatin1String("isLeftToRight")) ||
-                     (i.key() == QLatin1String("isTopToBottom"))) {
-                    settingsMain.setValue(i.key(), i.value());
-                } else {
-                    settings.setValue(i.key(), i.value());
-                }
-        }
-
-        QStringList comics;
-        if (settingsMain.contains(QLatin1String("comics"))) {
-            comics = settingsMain.value(QLatin1String("comics"), QStringList()).toStringList();
-        } else {
-            //existing strips haven't been stored in the conf-file yet, do that now, oldest first, newest last
-            QDir dir(dirPath);
-            comics = dir.entryList(QStringList() << QString::fromLatin1(QUrl::toPercentEncoding(comicName + QLatin1Char(':'))) + QLatin1Char('*'), QDir::Files, QDir::Time | QDir::Reversed);
-            QStringList::iterator it = comics.begin();
-            while (it != comics.end()) {
-                //only count images, not the conf files
-                if ((*it).endsWith(QLatin1String(".conf"))) {
-                    it = comics.erase(it);
-                } else {
-                    ++it;
-                }
-            }
-        }
-        comics.append(QString::fromLatin1(QUrl::toPercentEncoding(identifier)));
-
-        const int limit = CachedProvider::maxComicLimit();
-        //limit is on
-        if (limit > 0) {
-            qDebug() << QLatin1String("MaxComicLimit on.");
-            int comicsToRemove = comics.count() - limit;
-            QStringList::iterator it = comics.begin();
-            while (comicsToRemove > 0 && it != comics.end()) {
-                qDebug() << QLatin1String("Remove file") << (dirPath + (*it));
-                QFile::remove(dirPath + (*it));
-                QFile::remove(dirPath + (*it) + QLatin1String(".conf"));
-                it = comics.erase(it);
-                -- comicsToRemove;
-            }
-        }
-        settingsMain.setValue(QLatin1String("comics"), comics);
-    }
-
-    return comic.save(path, "PNG");
+    return ComicCache::self()->store(identifier, comic, info, data);
 }
 
 QUrl CachedProvider::websiteUrl() const
 {
-    QSettings settings(identifierToPath(requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return QUrl(settings.value(QLatin1String("websiteUrl")).toUrl());
+    return QUrl(mStripInfo.value(QLatin1String("websiteUrl")));
 }
 
 QUrl CachedProvider::imageUrl() const
 {
-    QSettings settings(identifierToPath(requestedString()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return QUrl(settings.value(QLatin1String("imageUrl")).toUrl());
+    return QUrl(mStripInfo.value(QLatin1String("imageUrl")));
 }
 
 QUrl CachedProvider::shopUrl() const
 {
-    QSettings settings(identifierToPath(requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return QUrl(settings.value(QLatin1String("shopUrl")).toUrl());
+    return QUrl(mComicInfo.value(QLatin1String("shopUrl")));
 }
 
 bool CachedProvider::isLeftToRight() const
 {
-    QSettings settings(identifierToPath(requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("isLeftToRight"), true).toBool();
+    return mComicInfo.value(QLatin1String("isLeftToRight"), QStringLiteral("1")).toInt();
 }
 
 bool CachedProvider::isTopToBottom() const
 {
-    QSettings settings(identifierToPath(requestedComicName()) + QLatin1String(".conf"), QSettings::IniFormat);
-    return settings.value(QLatin1String("isTopToBottom"), true).toBool();
+    return mComicInfo.value(QLatin1String("isTopToBottom"), QStringLiteral("1")).toInt();
 }
 
 int CachedProvider::maxComicLimit()
 {
-    QSettings settings(identifierToPath(QLatin1String("comic_settings.conf")), QSettings::IniFormat);
-    return  qMax(settings.value(QLatin1String("maxComics"), CACHE_DEFAULT).toInt(), 0);//old value was -1, thus use qMax
+    return ComicCache::self()->maxComicLimit();
 }
 
 void CachedProvider::setMaxComicLimit(int limit)
 {
-    if (limit < 0) {
-        qDebug() << "Wrong limit, setting to default.";
-        limit = CACHE_DEFAULT;
-    }
-    QSettings settings(identifierToPath(QLatin1String("comic_settings.conf")), QSettings::IniFormat);
-    settings.setValue(QLatin1String("maxComics"), limit);
+    ComicCache::self()->setMaxComicLimit(limit);
 }
-
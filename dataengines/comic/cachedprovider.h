@@ -20,8 +20,10 @@
 #define CACHEDPROVIDER_H
 
 #include "comicprovider.h"
+#include "comiccache.h"
 
-#include <QHash>
+#include <QImage>
+#include <QRunnable>
 
 /**
  * This class provides comics from the local cache.
@@ -61,10 +63,16 @@ class CachedProvider : public ComicProvider
          * Returns the requested image.
          *
          * Note: This method returns only a valid image after the
-         *       finished() signal has been emitted.
+         *       finished() signal has been emitted, the image is
+         *       decoded once in a worker thread.
          */
         QImage image() const override;
 
+        /**
+         * Returns the cached image as it was stored.
+         */
+        QByteArray imageData() const override;
+
         /**
          * Returns the identifier of the comic request (name + date).
          */
@@ -126,14 +134,16 @@ class CachedProvider : public ComicProvider
         static bool isCached(const QString &identifier);
 
         /**
-         * Map of keys and values to store in the config file for an individual identifier
+         * Map of keys and values to store in the cache index for an individual identifier
          */
-        typedef QHash<QString, QString> Settings;
+        typedef ComicCache::Settings Settings;
 
         /**
          * Stores the given @p comic with the given @p identifier in the cache.
+         * If the encoded @p data of the comic is available it is stored instead of
+         * encoding @p comic again.
          */
-        static bool storeInCache(const QString &identifier, const QImage &comic, const Settings &info = Settings());
+        static bool storeInCache(const QString &identifier, const QImage &comic, const Settings &info = Settings(), const QByteArray &data = QByteArray());
 
         /**
          * Returns the website of the comic.
@@ -159,10 +169,54 @@ class CachedProvider : public ComicProvider
         static void setMaxComicLimit(int limit);
 
     private Q_SLOTS:
-        void triggerFinished();
+        void triggerFinished(const QImage &image, const QByteArray &data);
+
+    private:
+        Settings mStripInfo;
+        Settings mComicInfo;
+        QImage mImage;
+        QByteArray mImageData;
+};
+
+/**
+ * Decodes a cached strip in the global thread pool.
+ */
+class LoadImageThread : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+    public:
+        explicit LoadImageThread(const QString &filePath);
+        void run() override;
+
+    Q_SIGNALS:
+        void done(const QImage &image, const QByteArray &data);
+
+    private:
+        QString mFilePath;
+};
+
+/**
+ * Downscales a strip to a width in the global thread pool, either @p image or
+ * the cached strip at @p filePath. The result is stored at @p variantPath and
+ * taken from there the next time, if that is not empty.
+ */
+class ScaleImageThread : public QObject, public QRunnable
+{
+    Q_OBJECT
+
+    public:
+        ScaleImageThread(const QImage &image, const QString &filePath, const QString &variantPath, int width);
+        void run() override;
+
+    Q_SIGNALS:
+        void done(const QImage &image);
 
     private:
-        static const int CACHE_DEFAULT;
+        QImage mImage;
+        QString mFilePath;
+        QString mVariantPath;
+        int mWidth;
 };
 
 #endif
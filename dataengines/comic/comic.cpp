@@ -19,34 +19,125 @@
 #include "comic.h"
 
 #include <QDate>
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
-#include <QSettings>
 #include <QImage>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QTimer>
 #include <QUrl>
 #include <QDebug>
+#include <QSettings>
 #include <QStandardPaths>
+#include <QThreadPool>
 
 #include <Plasma/DataContainer>
+#include <KDirWatch>
 #include <KPackage/PackageLoader>
+#include <KPluginMetaData>
 
 #include "cachedprovider.h"
+#include "comiccache.h"
+#include "comicproviderjson.h"
 #include "comicproviderkross.h"
+#include "comicstatistics.h"
+
+// decoded strips are big, a screenful of them is plenty for all consumers
+static const qint64 MAX_IMAGE_MEMORY = 32 * 1024 * 1024;
+
+static QStringList providerRoots()
+{
+    QStringList roots;
+    const QStringList locations = QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+    for (const QString &location : locations) {
+        roots << location + QLatin1String("/plasma/comics");
+    }
+    return roots;
+}
+
+static QString settingsPath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/comic_settings.conf");
+}
+
+// scaled:<width>:<identifier>
+static bool parseScaledSource(const QString &source, int *width, QString *identifier)
+{
+    const int index = source.indexOf(QLatin1Char(':'), 7);
+    if (index == -1) {
+        return false;
+    }
+    *width = ComicCache::variantWidth(source.mid(7, index - 7).toInt());
+    *identifier = source.mid(index + 1);
+    return *width > 0 && identifier->contains(QLatin1Char(':'));
+}
 
 ComicEngine::ComicEngine(QObject* parent, const QVariantList& args)
-    : Plasma::DataEngine(parent, args), mEmptySuffix(false)
+    : Plasma::DataEngine(parent, args), mEmptySuffix(false), mImageMemory(0), mProviderWatch(nullptr), mStatisticsTimer(nullptr)
 {
     setPollingInterval(0);
+    QSettings settings(settingsPath(), QSettings::IniFormat);
+    ComicProviderWrapper::setScriptThreads(settings.value(QLatin1String("scriptThreads"), 0).toInt());
+    mMaxImageMemory = settings.value(QLatin1String("maxImageMemory"), MAX_IMAGE_MEMORY).toLongLong();
     loadProviders();
+    init();
 }
 
 ComicEngine::~ComicEngine()
 {
+    qDeleteAll(m_jobs);
+    ComicProviderWrapper::shutdown();
 }
 
 void ComicEngine::init()
 {
     connect(&m_networkConfigurationManager, &QNetworkConfigurationManager::onlineStateChanged,
             this, &ComicEngine::onOnlineStateChanged);
+    connect(this, &Plasma::DataEngine::sourceRemoved, this, &ComicEngine::cancelRequest);
+    connect(this, &Plasma::DataEngine::sourceRemoved, this, &ComicEngine::forgetImage);
+
+    // comics get installed with GHNS or by hand while the engine runs
+    mProviderWatch = new KDirWatch(this);
+    const QStringList roots = providerRoots();
+    for (const QString &root : roots) {
+        mProviderWatch->addDir(root, KDirWatch::WatchSubDirs);
+    }
+    connect(mProviderWatch, &KDirWatch::dirty, this, &ComicEngine::providersChanged);
+    connect(mProviderWatch, &KDirWatch::created, this, &ComicEngine::providersChanged);
+    connect(mProviderWatch, &KDirWatch::deleted, this, &ComicEngine::providersChanged);
+
+    // counters change with every download, do not update the source that often
+    mStatisticsTimer = new QTimer(this);
+    mStatisticsTimer->setSingleShot(true);
+    mStatisticsTimer->setInterval(1000);
+    connect(mStatisticsTimer, &QTimer::timeout, this, &ComicEngine::updateStatistics);
+    // restarting the timer on every change would postpone the update for as long as downloads go on
+    connect(ComicStatistics::self(), &ComicStatistics::changed, this, [this]() {
+        if (!mStatisticsTimer->isActive()) {
+            mStatisticsTimer->start();
+        }
+    });
+}
+
+void ComicEngine::cancelRequest(const QString &identifier)
+{
+    // nobody is interested in the strip anymore, e.g. a prefetched strip
+    // after jumping elsewhere, deleting the provider stops its downloads
+    ComicProvider *provider = m_jobs.take(identifier);
+    if (provider) {
+        disconnect(provider, nullptr, this, nullptr);
+        mRevalidating.remove(identifier);
+        provider->deleteLater();
+    }
+
+    // a priority only applies to a request made right after setting it, the
+    // setting source goes away shortly after, take the unused one with it
+    if (identifier.startsWith(QLatin1String("setting_priority:"))) {
+        mPriorities.remove(identifier.mid(identifier.indexOf(QLatin1Char(':'), 17) + 1));
+    } else {
+        mPriorities.remove(identifier);
+    }
 }
 
 void ComicEngine::onOnlineStateChanged(bool isOnline)
@@ -54,34 +145,128 @@ void ComicEngine::onOnlineStateChanged(bool isOnline)
     if (isOnline && !mIdentifierError.isEmpty()) {
         sourceRequestEvent(mIdentifierError);
     }
+
+    // the most recent strips were answered from the cache, look for newer ones
+    // while still showing the cached ones
+    if (isOnline) {
+        const QStringList sources = mOfflineSources.values();
+        mOfflineSources.clear();
+        for (const QString &source : sources) {
+            if (containerForSource(source) && !m_jobs.contains(source)) {
+                mRevalidating.insert(source);
+                updateSourceEvent(source);
+            }
+        }
+    }
+}
+
+bool ComicEngine::isOnline() const
+{
+    return m_networkConfigurationManager.isOnline();
 }
 
 void ComicEngine::loadProviders()
 {
+    // packages might have been changed, do not reuse their loaded scripts
+    ComicProviderWrapper::clearPool();
     mProviders.clear();
     removeAllData(QLatin1String("providers"));
     auto comics = KPackage::PackageLoader::self()->listPackages(QStringLiteral("Plasma/Comic"));
     for (auto comic : comics) {
-        mProviders << comic.pluginId();
-
-        //qDebug() << "ComicEngine::loadProviders()  service name=" << comic.name();
-        QStringList data;
-        data << comic.name();
-        QFileInfo file(comic.iconName());
-        if (file.isRelative()) {
-            data << QStandardPaths::locate(QStandardPaths::GenericDataLocation, QString::fromLatin1("plasma/comics/%1/%2").arg(comic.pluginId(), comic.iconName()));
-        } else {
-            data << comic.iconName();
-        }
-        setData(QLatin1String("providers"), comic.pluginId(), data);
+        addProvider(comic);
     }
     forceImmediateUpdateOfAllVisualizations();
 }
 
+void ComicEngine::addProvider(const KPluginMetaData &comic)
+{
+    //qDebug() << "ComicEngine::loadProviders()  service name=" << comic.name();
+    // everything needed to start a request is looked up once here
+    const QString path = QFileInfo(comic.fileName()).absolutePath();
+    Provider provider;
+    provider.name = comic.name();
+    QFileInfo file(comic.iconName());
+    if (file.isRelative()) {
+        const QString icon = path + QLatin1Char('/') + comic.iconName();
+        provider.icon = QFile::exists(icon) ? icon : QString();
+    } else {
+        provider.icon = comic.iconName();
+    }
+    provider.suffixType = comic.value(QStringLiteral("X-KDE-PlasmaComicProvider-SuffixType"));
+    if (QFile::exists(path + QLatin1String("/metadata.desktop"))) {
+        provider.metadataPath = path + QLatin1String("/metadata.desktop");
+    }
+    if (QFile::exists(path + QLatin1String("/contents/code/main.json"))) {
+        provider.manifest = path + QLatin1String("/contents/code/main.json");
+    }
+    mProviders[comic.pluginId()] = provider;
+
+    setData(QLatin1String("providers"), comic.pluginId(), QStringList() << provider.name << provider.icon);
+}
+
+bool ComicEngine::updateProvider(const QString &pluginId)
+{
+    // the script of an updated comic has to be loaded again, the scripts of
+    // the other comics stay loaded
+    ComicProviderWrapper::clearPool(pluginId);
+    const KPackage::Package pkg = KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/Comic"), pluginId);
+    if (!pkg.isValid() || !pkg.metadata().isValid()) {
+        if (mProviders.remove(pluginId)) {
+            removeData(QLatin1String("providers"), pluginId);
+        }
+        return false;
+    }
+
+    addProvider(pkg.metadata());
+    return true;
+}
+
+void ComicEngine::providersChanged(const QString &path)
+{
+    const QStringList roots = providerRoots();
+    for (const QString &root : roots) {
+        if (path != root && !path.startsWith(root + QLatin1Char('/'))) {
+            continue;
+        }
+
+        // a comic changed, only that one is looked at again
+        const QString pluginId = path.mid(root.length() + 1).section(QLatin1Char('/'), 0, 0);
+        if (!pluginId.isEmpty()) {
+            updateProvider(pluginId);
+            return;
+        }
+
+        // comics were installed or removed, compare with the known ones
+        QSet<QString> installed;
+        for (const QString &other : roots) {
+            const QStringList dirs = QDir(other).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QString &dir : dirs) {
+                installed.insert(dir);
+            }
+        }
+        for (const QString &id : qAsConst(installed)) {
+            if (!mProviders.contains(id)) {
+                updateProvider(id);
+            }
+        }
+        const QStringList known = mProviders.keys();
+        for (const QString &id : known) {
+            if (!installed.contains(id)) {
+                mProviders.remove(id);
+                removeData(QLatin1String("providers"), id);
+            }
+        }
+        return;
+    }
+}
+
 bool ComicEngine::updateSourceEvent(const QString &identifier)
 {
     if (identifier == QLatin1String("providers")) {
-        loadProviders();
+        // the watch keeps the known comics up to date, no need to look at the packages again
+        for (auto it = mProviders.constBegin(); it != mProviders.constEnd(); ++it) {
+            setData(identifier, it.key(), QStringList() << it->name << it->icon);
+        }
         return true;
     } else if (identifier.startsWith(QLatin1String("setting_maxComicLimit:"))) {
         bool worked;
@@ -90,10 +275,87 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
             CachedProvider::setMaxComicLimit(maxComicLimit);
         }
         return worked;
+    } else if (identifier.startsWith(QLatin1String("setting_maxCacheSize:"))) {
+        bool worked;
+        const qint64 maxCacheSize = identifier.mid(21).toLongLong(&worked);
+        if (worked) {
+            ComicCache::self()->setMaxCacheSize(maxCacheSize);
+            updateCacheUsage();
+        }
+        return worked;
+    } else if (identifier.startsWith(QLatin1String("setting_scriptThreads:"))) {
+        bool worked;
+        const int scriptThreads = identifier.mid(22).toInt(&worked);
+        if (worked) {
+            QSettings settings(settingsPath(), QSettings::IniFormat);
+            settings.setValue(QLatin1String("scriptThreads"), scriptThreads);
+            ComicProviderWrapper::setScriptThreads(scriptThreads);
+        }
+        return worked;
+    } else if (identifier.startsWith(QLatin1String("setting_maxImageMemory:"))) {
+        bool worked;
+        const qint64 maxImageMemory = identifier.mid(23).toLongLong(&worked);
+        if (worked) {
+            QSettings settings(settingsPath(), QSettings::IniFormat);
+            settings.setValue(QLatin1String("maxImageMemory"), maxImageMemory);
+            mMaxImageMemory = maxImageMemory;
+            trimImages(QString());
+            if (containerForSource(QLatin1String("cache"))) {
+                updateCacheUsage();
+            }
+        }
+        return worked;
+    } else if (identifier.startsWith(QLatin1String("setting_priority:"))) {
+        const int index = identifier.indexOf(QLatin1Char(':'), 17);
+        if (index == -1) {
+            return false;
+        }
+        const QString name = identifier.mid(17, index - 17);
+        const QString comicIdentifier = identifier.mid(index + 1);
+        ComicProvider::RequestPriority priority;
+        if (name == QLatin1String("interactive")) {
+            priority = ComicProvider::InteractivePriority;
+        } else if (name == QLatin1String("prefetch")) {
+            priority = ComicProvider::PrefetchPriority;
+        } else if (name == QLatin1String("archive")) {
+            priority = ComicProvider::ArchivePriority;
+        } else {
+            return false;
+        }
+
+        // applies to the running request or to the next one, a request
+        // that is already more urgent for someone else stays so
+        if (ComicProvider *provider = m_jobs.value(comicIdentifier)) {
+            if (priority < provider->requestPriority()) {
+                provider->setRequestPriority(priority);
+            }
+        } else if (priority == ComicProvider::InteractivePriority) {
+            mPriorities.remove(comicIdentifier);
+        } else {
+            mPriorities[comicIdentifier] = priority;
+        }
+        return true;
+    } else if (identifier.startsWith(QLatin1String("scaled:"))) {
+        return requestScaledImage(identifier);
+    } else if (identifier == QLatin1String("cache")) {
+        updateCacheUsage();
+        return true;
+    } else if (identifier == QLatin1String("statistics")) {
+        updateStatistics();
+        return true;
+    } else if (identifier.startsWith(QLatin1String("statistics:"))) {
+        return dumpStatistics(identifier);
+    } else if (identifier.startsWith(QLatin1String("navigation:"))) {
+        updateNavigation(identifier.mid(11));
+        return true;
+    } else if (identifier.startsWith(QLatin1String("latest:"))) {
+        updateLatest(identifier.mid(7));
+        return true;
     } else {
         if (m_jobs.contains(identifier)) {
             return true;
         }
+        const int priority = mPriorities.take(identifier);
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
         const QStringList parts = identifier.split(QLatin1Char(':'), QString::KeepEmptyParts);
@@ -108,6 +370,7 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
 
             ComicProvider *provider = new CachedProvider(this, args);
             m_jobs[identifier] = provider;
+            ComicStatistics::self()->addRequest(parts[0], true);
             connect(provider, SIGNAL(finished(ComicProvider*)), this, SLOT(finished(ComicProvider*)));
             connect(provider, SIGNAL(error(ComicProvider*)), this, SLOT(error(ComicProvider*)));
             return true;
@@ -120,9 +383,8 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
             return false;
         }
         if (!mProviders.contains(parts[0])) {
-            // User might have installed more from GHNS
-            loadProviders();
-            if (!mProviders.contains(parts[0])) {
+            // User might have installed more from GHNS, before the watch noticed
+            if (!updateProvider(parts[0])) {
                 setData(identifier, QLatin1String("Error"), true);
                 qWarning() << identifier << "comic plugin does not seem to be installed.";
                 return false;
@@ -130,7 +392,23 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
         }
 
         // check if there is a connection
-        if (!m_networkConfigurationManager.isOnline()) {
+        if (!isOnline()) {
+            // the most recent strip known offline is the last cached one
+            const QString lastCachedId = parts[0] + QLatin1Char(':') + lastCachedIdentifier(identifier);
+            if (parts[1].isEmpty() && CachedProvider::isCached(lastCachedId)) {
+                QVariantList args;
+                args << QLatin1String("String") << lastCachedId;
+
+                ComicProvider *provider = new CachedProvider(this, args);
+                provider->setIsCurrent(true);
+                m_jobs[identifier] = provider;
+                ComicStatistics::self()->addRequest(parts[0], true);
+                mOfflineSources.insert(identifier);
+                connect(provider, SIGNAL(finished(ComicProvider*)), this, SLOT(finished(ComicProvider*)));
+                connect(provider, SIGNAL(error(ComicProvider*)), this, SLOT(error(ComicProvider*)));
+                return true;
+            }
+
             mIdentifierError = identifier;
             setData(identifier, QLatin1String("Error"), true);
             setData(identifier, QLatin1String("Error automatically fixable"), true);
@@ -140,7 +418,7 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
             return true;
         }
 
-        KPackage::Package pkg = KPackage::PackageLoader::self()->loadPackage(QStringLiteral("Plasma/Comic"), parts[0]);
+        const Provider info = mProviders.value(parts[0]);
 
         bool isCurrentComic = parts[1].isEmpty();
 
@@ -148,7 +426,7 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
         ComicProvider *provider = nullptr;
 
         //const QString type = service->property(QLatin1String("X-KDE-PlasmaComicProvider-SuffixType"), QVariant::String).toString();
-        const QString type = pkg.metadata().value(QStringLiteral("X-KDE-PlasmaComicProvider-SuffixType"));
+        const QString type = info.suffixType;
         if (type == QLatin1String("Date")) {
             QDate date = QDate::fromString(parts[1], Qt::ISODate);
             if (!date.isValid())
@@ -160,17 +438,25 @@ bool ComicEngine::updateSourceEvent(const QString &identifier)
         } else if (type == QLatin1String("String")) {
             args << QLatin1String("String") << parts[1];
         }
-        args << QStandardPaths::locate(QStandardPaths::GenericDataLocation, QLatin1String("plasma/comics/") + parts[0] + QLatin1String("/metadata.desktop"));
+        args << info.metadataPath;
 
         //provider = service->createInstance<ComicProvider>(this, args);
-        provider = new ComicProviderKross(this, args);
+        // comics described by a manifest do not need a script interpreter
+        if (!info.manifest.isEmpty()) {
+            args << info.manifest;
+            provider = new ComicProviderJson(this, args);
+        } else {
+            provider = new ComicProviderKross(this, args);
+        }
         if (!provider) {
             setData(identifier, QLatin1String("Error"), true);
             return false;
         }
         provider->setIsCurrent(isCurrentComic);
+        provider->setRequestPriority(static_cast<ComicProvider::RequestPriority>(priority));
 
         m_jobs[identifier] = provider;
+        ComicStatistics::self()->addRequest(parts[0], false);
 
         connect(provider, SIGNAL(finished(ComicProvider*)), this, SLOT(finished(ComicProvider*)));
         connect(provider, SIGNAL(error(ComicProvider*)), this, SLOT(error(ComicProvider*)));
@@ -187,13 +473,19 @@ bool ComicEngine::sourceRequestEvent(const QString &identifier)
 
 void ComicEngine::finished(ComicProvider *provider)
 {
-    // sets the data
-    setComicData(provider);
-    if (provider->image().isNull()) {
+    // the image is only fetched once, as it can be expensive to create
+    const QImage image = provider->image();
+    if (image.isNull()) {
         error(provider);
         return;
     }
 
+    // sets the data
+    setComicData(provider, image);
+    if (provider->inherits("CachedProvider") && !isOnline()) {
+        linkCachedNeighbours(provider);
+    }
+
     // different comic -- with no error yet -- has been chosen, old error is invalidated
     QString temp = mIdentifierError.left(mIdentifierError.indexOf(QLatin1Char(':')) + 1);
     if (!mIdentifierError.isEmpty() && provider->identifier().indexOf(temp) == -1) {
@@ -204,11 +496,25 @@ void ComicEngine::finished(ComicProvider *provider)
         mIdentifierError.clear();
     }
 
+    // remember how the strips are linked, that way navigation and archiving
+    // can be planned without asking the website
+    if (!provider->inherits("CachedProvider")) {
+        const QString name = provider->identifier().left(provider->identifier().indexOf(QLatin1Char(':')));
+        const QString suffix = provider->identifier().mid(name.length() + 1);
+        ComicCache::self()->storeLinks(provider->identifier(), provider->previousIdentifier(), provider->nextIdentifier());
+        ComicCache::self()->storeBounds(name, provider->firstStripIdentifier(), provider->nextIdentifier().isEmpty() ? suffix : QString());
+        if (containerForSource(QLatin1String("navigation:") + name)) {
+            updateNavigation(name);
+        }
+        if (containerForSource(QLatin1String("latest:") + name)) {
+            updateLatest(name);
+        }
+    }
+
     // store in cache if it's not the response of a CachedProvider,
     // if there is a valid image and if there is a next comic
     // (if we're on today's comic it could become stale)
-    if (!provider->inherits("CachedProvider") && !provider->image().isNull() &&
-         !provider->nextIdentifier().isEmpty()) {
+    if (!provider->inherits("CachedProvider") && !provider->nextIdentifier().isEmpty()) {
         CachedProvider::Settings info;
 
         info[QLatin1String("websiteUrl")] = provider->websiteUrl().toString(QUrl::PrettyDecoded);
@@ -238,20 +544,38 @@ void ComicEngine::finished(ComicProvider *provider)
             info[QLatin1String("stripTitle")] = provider->stripTitle();
         }
 
-        CachedProvider::storeInCache(provider->identifier(), provider->image(), info);
+        CachedProvider::storeInCache(provider->identifier(), image, info, provider->imageData());
+        if (ComicCache::self()->contains(provider->identifier())) {
+            setData(sourceFor(provider), QLatin1String("Image Path"), ComicCache::self()->imagePath(provider->identifier()));
+        }
+        if (containerForSource(QLatin1String("cache"))) {
+            updateCacheUsage();
+        }
     }
     provider->deleteLater();
 
     const QString key = m_jobs.key(provider);
     if (!key.isEmpty()) {
         m_jobs.remove(key);
+        mRevalidating.remove(key);
+        serveScaledRequests(key);
     }
 }
 
 void ComicEngine::error(ComicProvider *provider)
 {
+    // keep showing the cached strip if there is no newer one
+    const QString revalidated = m_jobs.key(provider);
+    if (!revalidated.isEmpty() && mRevalidating.remove(revalidated)) {
+        qDebug() << revalidated << "could not be revalidated, keeping the cached strip.";
+        m_jobs.remove(revalidated);
+        provider->deleteLater();
+        serveScaledRequests(revalidated);
+        return;
+    }
+
     // sets the data
-    setComicData(provider);
+    setComicData(provider, provider->image());
 
     QString identifier(provider->identifier());
     mIdentifierError = identifier;
@@ -280,12 +604,13 @@ void ComicEngine::error(ComicProvider *provider)
     const QString key = m_jobs.key(provider);
     if (!key.isEmpty()) {
         m_jobs.remove(key);
+        serveScaledRequests(key);
     }
 
     provider->deleteLater();
 }
 
-void ComicEngine::setComicData(ComicProvider *provider)
+QString ComicEngine::sourceFor(ComicProvider *provider) const
 {
     QString identifier(provider->identifier());
 
@@ -297,7 +622,16 @@ void ComicEngine::setComicData(ComicProvider *provider)
     if (provider->isCurrent())
         identifier = identifier.left(identifier.indexOf(QLatin1Char(':')) + 1);
 
-    setData(identifier, QLatin1String("Image"), provider->image());
+    return identifier;
+}
+
+void ComicEngine::setComicData(ComicProvider *provider, const QImage &image)
+{
+    const QString identifier = sourceFor(provider);
+    ComicCache *cache = ComicCache::self();
+
+    setData(identifier, QLatin1String("Image"), image);
+    setData(identifier, QLatin1String("Image Path"), cache->contains(provider->identifier()) ? cache->imagePath(provider->identifier()) : QString());
     setData(identifier, QLatin1String("Website Url"), provider->websiteUrl());
     setData(identifier, QLatin1String("Image Url"), provider->imageUrl());
     setData(identifier, QLatin1String("Shop Url"), provider->shopUrl());
@@ -313,17 +647,242 @@ void ComicEngine::setComicData(ComicProvider *provider)
     setData(identifier, QLatin1String("isLeftToRight"), provider->isLeftToRight());
     setData(identifier, QLatin1String("isTopToBottom"), provider->isTopToBottom());
     setData(identifier, QLatin1String("Error"), false);
+
+    trackImage(identifier, image);
+}
+
+void ComicEngine::trackImage(const QString &source, const QImage &image)
+{
+    mImageMemory -= mImageSizes.value(source);
+    mImageOrder.removeOne(source);
+    if (image.isNull()) {
+        mImageSizes.remove(source);
+        return;
+    }
+
+    mImageSizes[source] = image.sizeInBytes();
+    mImageMemory += image.sizeInBytes();
+    mImageOrder << source;
+    trimImages(source);
+}
+
+void ComicEngine::forgetImage(const QString &source)
+{
+    if (mImageSizes.contains(source)) {
+        mImageMemory -= mImageSizes.take(source);
+        mImageOrder.removeOne(source);
+    }
+}
+
+void ComicEngine::trimImages(const QString &keep)
+{
+    // only sources nobody is connected to anymore are dropped, oldest first,
+    // consumers of the others rely on their "Image"
+    const QStringList sources = mImageOrder;
+    for (const QString &source : sources) {
+        if (mImageMemory <= mMaxImageMemory) {
+            break;
+        }
+        if (source == keep) {
+            continue;
+        }
+        Plasma::DataContainer *container = containerForSource(source);
+        if (!container) {
+            forgetImage(source);
+        } else if (!container->isUsed()) {
+            removeSource(source);
+        }
+    }
+}
+
+bool ComicEngine::requestScaledImage(const QString &source)
+{
+    int width;
+    QString identifier;
+    if (!parseScaledSource(source, &width, &identifier)) {
+        setData(source, QLatin1String("Error"), true);
+        return false;
+    }
+
+    Plasma::DataContainer *original = containerForSource(identifier);
+    if ((original && !original->data().value(QLatin1String("Image")).value<QImage>().isNull()) || ComicCache::self()->contains(identifier)) {
+        scaleImage(source);
+        return true;
+    }
+
+    // the original strip has to be there first, requested just for this if nobody else did
+    mScaledRequests.insert(identifier, source);
+    if (!original) {
+        mScaledOriginals.insert(identifier);
+        sourceRequestEvent(identifier);
+    }
+    if (!m_jobs.contains(identifier)) {
+        serveScaledRequests(identifier);
+    }
+    return true;
+}
+
+void ComicEngine::scaleImage(const QString &source)
+{
+    int width;
+    QString identifier;
+    parseScaledSource(source, &width, &identifier);
+
+    // the strip being displayed is at hand, others are read from the cache, for the
+    // latest strip the source name does not have the suffix
+    QImage image;
+    if (Plasma::DataContainer *original = containerForSource(identifier)) {
+        image = original->data().value(QLatin1String("Image")).value<QImage>();
+        if (!image.isNull()) {
+            identifier = original->data().value(QLatin1String("Identifier")).toString();
+        }
+    }
+
+    ComicCache *cache = ComicCache::self();
+    const bool isCached = cache->contains(identifier);
+    ScaleImageThread *thread = new ScaleImageThread(image, isCached ? cache->imagePath(identifier) : QString(),
+                                                    isCached ? cache->variantPath(identifier, width) : QString(), width);
+    connect(thread, &ScaleImageThread::done, this, [this, source, identifier](const QImage &scaled) {
+        if (!containerForSource(source)) {
+            return;
+        }
+        setData(source, QLatin1String("Image"), scaled);
+        setData(source, QLatin1String("Identifier"), identifier);
+        setData(source, QLatin1String("Error"), scaled.isNull());
+        trackImage(source, scaled);
+    });
+    QThreadPool::globalInstance()->start(thread);
+}
+
+void ComicEngine::serveScaledRequests(const QString &identifier)
+{
+    const QStringList sources = mScaledRequests.values(identifier);
+    mScaledRequests.remove(identifier);
+
+    Plasma::DataContainer *original = containerForSource(identifier);
+    const bool hasImage = (original && !original->data().value(QLatin1String("Image")).value<QImage>().isNull()) || ComicCache::self()->contains(identifier);
+    for (const QString &source : sources) {
+        if (!containerForSource(source)) {
+            continue;
+        }
+        if (hasImage) {
+            scaleImage(source);
+        } else {
+            setData(source, QLatin1String("Error"), true);
+        }
+    }
+
+    // the image is passed on already
+    if (mScaledOriginals.remove(identifier) && original && !original->isUsed()) {
+        removeSource(identifier);
+    }
+}
+
+void ComicEngine::updateCacheUsage()
+{
+    ComicCache *cache = ComicCache::self();
+    const QString source = QLatin1String("cache");
+    setData(source, QLatin1String("Size"), cache->size());
+    setData(source, QLatin1String("Maximum size"), cache->maxCacheSize());
+    setData(source, QLatin1String("Strips"), cache->stripCount());
+    setData(source, QLatin1String("Comics"), cache->comicCount());
+    setData(source, QLatin1String("Maximum strips per comic"), cache->maxComicLimit());
+    setData(source, QLatin1String("Image memory"), mImageMemory);
+    setData(source, QLatin1String("Maximum image memory"), mMaxImageMemory);
+}
+
+void ComicEngine::updateStatistics()
+{
+    const QString source = QLatin1String("statistics");
+    if (!containerForSource(source)) {
+        return;
+    }
+
+    ComicStatistics *statistics = ComicStatistics::self();
+    const QStringList comics = statistics->comics();
+    for (const QString &comic : comics) {
+        setData(source, comic, statistics->statistics(comic));
+    }
+}
+
+bool ComicEngine::dumpStatistics(const QString &identifier)
+{
+    QString path = identifier.mid(11);
+    if (path.isEmpty()) {
+        path = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/statistics.json");
+    }
+
+    QDir().mkpath(QFileInfo(path).path());
+    QSaveFile file(path);
+    const bool worked = file.open(QIODevice::WriteOnly)
+                        && file.write(QJsonDocument(ComicStatistics::self()->toJson()).toJson()) != -1
+                        && file.commit();
+    if (!worked) {
+        qWarning() << "Could not write the statistics to" << path;
+    }
+    setData(identifier, QLatin1String("Path"), path);
+    setData(identifier, QLatin1String("Error"), !worked);
+    return worked;
+}
+
+void ComicEngine::updateNavigation(const QString &comicName)
+{
+    ComicCache *cache = ComicCache::self();
+    const QString source = QLatin1String("navigation:") + comicName;
+    setData(source, QLatin1String("First strip identifier suffix"), cache->firstStrip(comicName));
+    setData(source, QLatin1String("Last strip identifier suffix"), cache->lastStrip(comicName));
+    setData(source, QLatin1String("Last checked"), cache->lastChecked(comicName));
+    setData(source, QLatin1String("Identifier suffixes"), cache->strips(comicName));
+}
+
+void ComicEngine::updateLatest(const QString &comicName)
+{
+    ComicCache *cache = ComicCache::self();
+    const QString source = QLatin1String("latest:") + comicName;
+    setData(source, QLatin1String("Last strip identifier suffix"), cache->lastStrip(comicName));
+    setData(source, QLatin1String("Last checked"), cache->lastChecked(comicName));
+}
+
+void ComicEngine::linkCachedNeighbours(ComicProvider *provider)
+{
+    QString identifier(provider->identifier());
+    const QString name = identifier.left(identifier.indexOf(QLatin1Char(':')));
+    const QString suffix = identifier.mid(name.length() + 1);
+    if (provider->isCurrent()) {
+        identifier = name + QLatin1Char(':');
+    }
+
+    // offline only cached strips can be shown, skip to the closest linked one
+    const QStringList strips = ComicCache::self()->strips(name);
+    const int index = strips.indexOf(suffix);
+    if (index == -1) {
+        return;
+    }
+
+    const QString next = provider->nextIdentifier();
+    if (!next.isEmpty() && !CachedProvider::isCached(name + QLatin1Char(':') + next)) {
+        for (int i = index + 1; i < strips.count(); ++i) {
+            if (CachedProvider::isCached(name + QLatin1Char(':') + strips[i])) {
+                setData(identifier, QLatin1String("Next identifier suffix"), strips[i]);
+                break;
+            }
+        }
+    }
+    const QString previous = provider->previousIdentifier();
+    if (!previous.isEmpty() && !CachedProvider::isCached(name + QLatin1Char(':') + previous)) {
+        for (int i = index - 1; i >= 0; --i) {
+            if (CachedProvider::isCached(name + QLatin1Char(':') + strips[i])) {
+                setData(identifier, QLatin1String("Previous identifier suffix"), strips[i]);
+                break;
+            }
+        }
+    }
 }
 
 QString ComicEngine::lastCachedIdentifier(const QString &identifier) const
 {
         const QString id = identifier.left(identifier.indexOf(QLatin1Char(':')));
-        QString data = QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/");
-        data += QString::fromLatin1(QUrl::toPercentEncoding(id));
-        QSettings settings(data + QLatin1String(".conf"), QSettings::IniFormat);
-        QString previousIdentifier = settings.value(QLatin1String("lastCachedStripIdentifier"), QString()).toString();
-
-        return previousIdentifier;
+        return ComicCache::self()->comicInfo(id).value(QLatin1String("lastCachedStripIdentifier"));
 }
 
 K_EXPORT_PLASMA_DATAENGINE_WITH_JSON(comic, ComicEngine, "plasma-dataengine-comic.json")
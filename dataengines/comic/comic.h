@@ -21,9 +21,15 @@
 
 #include <Plasma/DataEngine>
 // Qt
+#include <QMultiHash>
 #include <QNetworkConfigurationManager>
+#include <QSet>
 
 class ComicProvider;
+class KDirWatch;
+class KPluginMetaData;
+class QImage;
+class QTimer;
 
 /**
  * This class provides the comic strip.
@@ -37,6 +43,49 @@ class ComicProvider;
  *   xkcd:378
  * if the suffix is empty the latest comic will be returned
  *
+ * The source "providers" lists the installed comics, it follows comics
+ * being installed, updated or removed.
+ *
+ * Without a network connection the latest comic is the last cached one and
+ * navigation skips to cached strips, once online again the latest comic is
+ * looked up in the background.
+ *
+ * Besides the decoded "Image" a strip has the "Image Path" of the file in
+ * the strip cache, as it was downloaded, empty if it is not cached.
+ *
+ * The decoded images of all sources together are kept below a budget
+ * that can be changed with setting_maxImageMemory:\<bytes\>. Above it, sources
+ * nobody is connected to anymore are removed, connected sources always keep
+ * their "Image".
+ *
+ * A strip downscaled to fit a view can be requested with
+ * scaled:\<width\>:\<comic_identifier\>:\<suffix\>, it has an "Image", the
+ * "Identifier" of the strip and "Error". The width is rounded up to a few steps,
+ * the variants of cached strips are cached as well.
+ *
+ * The source "cache" reports the usage of the strip cache, its
+ * size budget in bytes can be changed with setting_maxCacheSize:\<bytes\>
+ *
+ * The source navigation:\<comic_identifier\> reports the known first and
+ * last strip and all identifier suffixes that are known to be linked.
+ * latest:\<comic_identifier\> only has the "Last strip identifier suffix" and
+ * when it was "Last checked", without walking the links of all cached strips.
+ *
+ * The source "statistics" has an entry per comic with its requests, cache
+ * hits and misses, downloaded bytes, timeouts, the time spent in its script
+ * and histograms of the download latency and of the script calls.
+ * statistics:\<file\> writes them as JSON to file, to
+ * plasma_engine_comic/statistics.json in the data location if file is empty.
+ *
+ * With setting_scriptThreads:\<count\> the scripts of the comics are run
+ * in up to count worker threads instead of the main thread, 0 (the default)
+ * disables that again for comics requested afterwards. Only QtScript comics
+ * are run there, the other interpreters stay in the main thread.
+ *
+ * Downloads of strips that are not displayed can be given a lower priority
+ * right before requesting them with setting_priority:\<priority\>:\<comic_identifier\>:\<suffix\>,
+ * priority being one of interactive (the default), prefetch or archive.
+ *
  */
 class ComicEngine : public Plasma::DataEngine
 {
@@ -52,6 +101,10 @@ class ComicEngine : public Plasma::DataEngine
     protected:
         void init();
         bool sourceRequestEvent(const QString &identifier) override;
+        /**
+         * Returns whether strips can be downloaded, tests serving them locally override it
+         */
+        virtual bool isOnline() const;
 
     protected Q_SLOTS:
         bool updateSourceEvent(const QString &identifier) override;
@@ -60,14 +113,50 @@ class ComicEngine : public Plasma::DataEngine
         void finished(ComicProvider*);
         void error(ComicProvider*);
         void onOnlineStateChanged(bool);
+        void cancelRequest(const QString &identifier);
+        void forgetImage(const QString &source);
+        void providersChanged(const QString &path);
+        void updateStatistics();
 
     private:
+        struct Provider {
+            QString name;
+            QString icon;
+            QString suffixType;
+            QString metadataPath;
+            QString manifest;
+        };
+
         bool mEmptySuffix;
-        void setComicData(ComicProvider *provider);
+        void addProvider(const KPluginMetaData &comic);
+        bool updateProvider(const QString &pluginId);
+        QString sourceFor(ComicProvider *provider) const;
+        void setComicData(ComicProvider *provider, const QImage &image);
+        void trackImage(const QString &source, const QImage &image);
+        void trimImages(const QString &keep);
+        bool requestScaledImage(const QString &source);
+        void scaleImage(const QString &source);
+        void serveScaledRequests(const QString &identifier);
+        void updateCacheUsage();
+        void updateNavigation(const QString &comicName);
+        void updateLatest(const QString &comicName);
+        bool dumpStatistics(const QString &identifier);
+        void linkCachedNeighbours(ComicProvider *provider);
         QString lastCachedIdentifier(const QString &identifier) const;
         QString mIdentifierError;
-        QStringList mProviders;
+        QHash<QString, Provider> mProviders;
         QHash<QString, ComicProvider*> m_jobs;
+        QHash<QString, int> mPriorities;
+        QSet<QString> mOfflineSources;
+        QSet<QString> mRevalidating;
+        QHash<QString, qint64> mImageSizes;
+        QStringList mImageOrder;
+        QMultiHash<QString, QString> mScaledRequests;
+        QSet<QString> mScaledOriginals;
+        qint64 mImageMemory;
+        qint64 mMaxImageMemory;
+        KDirWatch *mProviderWatch;
+        QTimer *mStatisticsTimer;
         QNetworkConfigurationManager m_networkConfigurationManager;
 };
 
@@ -0,0 +1,784 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "comiccache.h"
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QLockFile>
+#include <QMultiMap>
+#include <QSaveFile>
+#include <QSet>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QUrl>
+
+static const quint32 INDEX_MAGIC = 0x434f4d43; // "COMC"
+static const quint32 INDEX_VERSION = 1;
+static const int LOCK_TIMEOUT = 5000; // ms
+static const int CACHE_DEFAULT = 20;
+static const qint64 CACHE_SIZE_DEFAULT = 100 * 1024 * 1024;
+// variants come in steps, resizing a view must not create new ones all the time
+static const int VARIANT_STEP = 256;
+static const int MAX_VARIANT_WIDTH = 4096;
+
+ComicCache *ComicCache::self()
+{
+    static ComicCache cache;
+    return &cache;
+}
+
+ComicCache::ComicCache()
+    : mDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/")),
+      mLock(mDir + QLatin1String("index.lock")),
+      mLoaded(false),
+      mRecords(0),
+      mGeneration(0),
+      mIndexSize(0),
+      mMaxComicLimit(-1),
+      mMaxCacheSize(-1),
+      mSize(0)
+{
+}
+
+QString ComicCache::comicName(const QString &identifier)
+{
+    return identifier.left(identifier.indexOf(QLatin1Char(':')));
+}
+
+bool ComicCache::isComicKey(const QString &key)
+{
+    return (key == QLatin1String("firstStripIdentifier")) || (key == QLatin1String("title")) ||
+           (key == QLatin1String("lastCachedStripIdentifier")) || (key == QLatin1String("suffixType")) ||
+           (key == QLatin1String("shopUrl")) || (key == QLatin1String("isLeftToRight")) ||
+           (key == QLatin1String("isTopToBottom"));
+}
+
+QString ComicCache::imagePath(const QString &identifier) const
+{
+    return mDir + QString::fromLatin1(QUrl::toPercentEncoding(identifier));
+}
+
+QString ComicCache::variantPath(const QString &identifier, int width) const
+{
+    return mDir + QLatin1String("variants/") + QString::fromLatin1(QUrl::toPercentEncoding(identifier)) + QLatin1Char('_') + QString::number(width);
+}
+
+int ComicCache::variantWidth(int width)
+{
+    if (width <= 0 || width > MAX_VARIANT_WIDTH) {
+        return 0;
+    }
+    return (width + VARIANT_STEP - 1) / VARIANT_STEP * VARIANT_STEP;
+}
+
+void ComicCache::removeVariants(const QString &identifier)
+{
+    for (int width = VARIANT_STEP; width <= MAX_VARIANT_WIDTH; width += VARIANT_STEP) {
+        QFile::remove(variantPath(identifier, width));
+    }
+}
+
+bool ComicCache::contains(const QString &identifier)
+{
+    load();
+    return mStrips.contains(identifier);
+}
+
+ComicCache::Settings ComicCache::stripInfo(const QString &identifier)
+{
+    load();
+    return mStrips.value(identifier).info;
+}
+
+ComicCache::Settings ComicCache::comicInfo(const QString &comicName)
+{
+    load();
+    return mComics.value(comicName).info;
+}
+
+bool ComicCache::store(const QString &identifier, const QImage &comic, const Settings &info, const QByteArray &data)
+{
+    if (!beginChange()) {
+        return false;
+    }
+
+    const qint64 size = writeImage(identifier, comic, data);
+    if (size < 0) {
+        qWarning() << "Could not store" << identifier << "in the cache.";
+        endChange();
+        return false;
+    }
+
+    const QString name = comicName(identifier);
+    ComicEntry &entry = mComics[name];
+
+    Settings stripInfo;
+    bool comicChanged = false;
+    for (Settings::const_iterator it = info.constBegin(); it != info.constEnd(); ++it) {
+        if (isComicKey(it.key())) {
+            if (entry.info.value(it.key()) != it.value()) {
+                entry.info[it.key()] = it.value();
+                comicChanged = true;
+            }
+        } else {
+            stripInfo[it.key()] = it.value();
+        }
+    }
+    if (comicChanged) {
+        writeComic(name, entry.info);
+    }
+
+    insertStrip(identifier, stripInfo, size);
+    writeStrip(identifier, mStrips.value(identifier));
+
+    const int limit = maxComicLimit();
+    if (limit > 0) {
+        while (static_cast<int>(entry.strips.size()) > limit) {
+            const QString oldest = entry.strips.front();
+            qDebug() << "Remove file" << imagePath(oldest);
+            removeStrip(oldest, true);
+            writeRemove(oldest);
+        }
+    }
+    evict(identifier);
+
+    endChange();
+    return true;
+}
+
+qint64 ComicCache::writeImage(const QString &identifier, const QImage &comic, const QByteArray &data)
+{
+    removeVariants(identifier);
+
+    //the downloaded data is kept as is, that way no time is spent on encoding
+    //and the file is usually smaller than a PNG of the same strip
+    if (!data.isEmpty()) {
+        QFile file(imagePath(identifier));
+        if (file.open(QIODevice::WriteOnly) && file.write(data) == data.size()) {
+            return data.size();
+        }
+        qWarning() << "Could not write the original image data of" << identifier << ", encoding it instead.";
+    }
+
+    if (!comic.save(imagePath(identifier), "PNG")) {
+        return -1;
+    }
+    return QFileInfo(imagePath(identifier)).size();
+}
+
+void ComicCache::remove(const QString &identifier)
+{
+    if (!beginChange()) {
+        return;
+    }
+    if (mStrips.contains(identifier)) {
+        removeStrip(identifier, true);
+        writeRemove(identifier);
+    }
+    endChange();
+}
+
+void ComicCache::touch(const QString &identifier)
+{
+    //shown strips are touched all the time, do not lock the index when nothing changes
+    load();
+    if (!mStrips.contains(identifier) || mUsage.back() == identifier || !beginChange()) {
+        return;
+    }
+    if (mStrips.contains(identifier) && mUsage.back() != identifier) {
+        touchStrip(identifier);
+        writeTouch(identifier);
+    }
+    endChange();
+}
+
+void ComicCache::insertStrip(const QString &identifier, const Settings &info, qint64 size)
+{
+    QHash<QString, StripEntry>::iterator it = mStrips.find(identifier);
+    if (it != mStrips.end()) {
+        mSize += size - it->size;
+        it->info = info;
+        it->size = size;
+        touchStrip(identifier);
+        return;
+    }
+
+    ComicEntry &entry = mComics[comicName(identifier)];
+    StripEntry strip;
+    strip.info = info;
+    strip.size = size;
+    strip.usage = mUsage.insert(mUsage.end(), identifier);
+    strip.comicUsage = entry.strips.insert(entry.strips.end(), identifier);
+    mStrips.insert(identifier, strip);
+    mSize += size;
+}
+
+void ComicCache::touchStrip(const QString &identifier)
+{
+    QHash<QString, StripEntry>::iterator it = mStrips.find(identifier);
+    if (it == mStrips.end()) {
+        return;
+    }
+
+    //splicing keeps the iterators valid, so moving a strip to the back is O(1)
+    mUsage.splice(mUsage.end(), mUsage, it->usage);
+    UsageList &comicStrips = mComics[comicName(identifier)].strips;
+    comicStrips.splice(comicStrips.end(), comicStrips, it->comicUsage);
+}
+
+void ComicCache::removeStrip(const QString &identifier, bool removeFile)
+{
+    QHash<QString, StripEntry>::iterator it = mStrips.find(identifier);
+    if (it == mStrips.end()) {
+        return;
+    }
+
+    if (removeFile) {
+        QFile::remove(imagePath(identifier));
+        removeVariants(identifier);
+    }
+
+    mSize -= it->size;
+    mUsage.erase(it->usage);
+    QHash<QString, ComicEntry>::iterator comic = mComics.find(comicName(identifier));
+    if (comic != mComics.end()) {
+        comic->strips.erase(it->comicUsage);
+    }
+    mStrips.erase(it);
+}
+
+void ComicCache::evict(const QString &keep)
+{
+    const qint64 maxSize = maxCacheSize();
+    if (maxSize <= 0) {
+        return;
+    }
+
+    UsageList::iterator it = mUsage.begin();
+    while (mSize > maxSize && it != mUsage.end()) {
+        if (*it == keep) {
+            ++it;
+            continue;
+        }
+        const QString oldest = *it;
+        ++it;
+        qDebug() << "Remove file" << imagePath(oldest);
+        removeStrip(oldest, true);
+        writeRemove(oldest);
+    }
+}
+
+void ComicCache::storeLinks(const QString &identifier, const QString &previous, const QString &next)
+{
+    const QString suffix = identifier.mid(identifier.indexOf(QLatin1Char(':')) + 1);
+    if (suffix.isEmpty() || !beginChange()) {
+        return;
+    }
+
+    NavigationEntry &navigation = mNavigation[comicName(identifier)];
+    StripLinks &links = navigation.links[suffix];
+    //a strip without next is the most recent one, its next link shows up later
+    const QString newNext = next.isEmpty() ? links.next : next;
+    if (links.previous != previous || links.next != newNext) {
+        links.previous = previous;
+        links.next = newNext;
+        writeLinks(identifier, links);
+    }
+    endChange();
+}
+
+void ComicCache::storeBounds(const QString &comicName, const QString &first, const QString &last)
+{
+    if (!beginChange()) {
+        return;
+    }
+
+    NavigationEntry &navigation = mNavigation[comicName];
+    if (!last.isEmpty() || (!first.isEmpty() && first != navigation.first)) {
+        if (!first.isEmpty()) {
+            navigation.first = first;
+        }
+        if (!last.isEmpty()) {
+            navigation.last = last;
+            navigation.lastChecked = QDateTime::currentDateTimeUtc();
+        }
+        writeBounds(comicName, navigation);
+    }
+    endChange();
+}
+
+QString ComicCache::firstStrip(const QString &comicName)
+{
+    load();
+    const QString first = mNavigation.value(comicName).first;
+    return first.isEmpty() ? mComics.value(comicName).info.value(QLatin1String("firstStripIdentifier")) : first;
+}
+
+QString ComicCache::lastStrip(const QString &comicName)
+{
+    load();
+    return mNavigation.value(comicName).last;
+}
+
+QDateTime ComicCache::lastChecked(const QString &comicName)
+{
+    load();
+    return mNavigation.value(comicName).lastChecked;
+}
+
+QStringList ComicCache::followLinks(const QHash<QString, StripLinks> &links, QString suffix)
+{
+    QStringList chain;
+    QSet<QString> visited;
+    while (!suffix.isEmpty() && !visited.contains(suffix)) {
+        visited.insert(suffix);
+        chain << suffix;
+        suffix = links.value(suffix).next;
+    }
+    return chain;
+}
+
+QStringList ComicCache::strips(const QString &comicName)
+{
+    load();
+    const NavigationEntry navigation = mNavigation.value(comicName);
+
+    //start at every strip whose predecessor is unknown and keep the longest run
+    QStringList result = followLinks(navigation.links, firstStrip(comicName));
+    for (QHash<QString, StripLinks>::const_iterator it = navigation.links.constBegin(); it != navigation.links.constEnd(); ++it) {
+        if (it->previous.isEmpty() || !navigation.links.contains(it->previous)) {
+            const QStringList chain = followLinks(navigation.links, it.key());
+            if (chain.count() > result.count()) {
+                result = chain;
+            }
+        }
+    }
+    return result;
+}
+
+qint64 ComicCache::size()
+{
+    load();
+    return mSize;
+}
+
+int ComicCache::stripCount()
+{
+    load();
+    return mStrips.count();
+}
+
+int ComicCache::comicCount()
+{
+    load();
+    int count = 0;
+    for (const ComicEntry &entry : qAsConst(mComics)) {
+        if (!entry.strips.empty()) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+int ComicCache::maxComicLimit()
+{
+    if (mMaxComicLimit < 0) {
+        QSettings settings(mDir + QLatin1String("comic_settings.conf"), QSettings::IniFormat);
+        mMaxComicLimit = qMax(settings.value(QLatin1String("maxComics"), CACHE_DEFAULT).toInt(), 0);//old value was -1, thus use qMax
+    }
+    return mMaxComicLimit;
+}
+
+void ComicCache::setMaxComicLimit(int limit)
+{
+    if (limit < 0) {
+        qDebug() << "Wrong limit, setting to default.";
+        limit = CACHE_DEFAULT;
+    }
+    if (limit == mMaxComicLimit) {
+        return;
+    }
+    mMaxComicLimit = limit;
+    QSettings settings(mDir + QLatin1String("comic_settings.conf"), QSettings::IniFormat);
+    settings.setValue(QLatin1String("maxComics"), limit);
+}
+
+qint64 ComicCache::maxCacheSize()
+{
+    if (mMaxCacheSize < 0) {
+        QSettings settings(mDir + QLatin1String("comic_settings.conf"), QSettings::IniFormat);
+        mMaxCacheSize = qMax(settings.value(QLatin1String("maxCacheSize"), CACHE_SIZE_DEFAULT).toLongLong(), qint64(0));
+    }
+    return mMaxCacheSize;
+}
+
+void ComicCache::setMaxCacheSize(qint64 size)
+{
+    if (size < 0) {
+        qDebug() << "Wrong cache size, setting to default.";
+        size = CACHE_SIZE_DEFAULT;
+    }
+    if (size == mMaxCacheSize) {
+        return;
+    }
+    mMaxCacheSize = size;
+    QSettings settings(mDir + QLatin1String("comic_settings.conf"), QSettings::IniFormat);
+    settings.setValue(QLatin1String("maxCacheSize"), size);
+
+    //a smaller budget applies right away, not only once the next strip gets stored
+    if (beginChange()) {
+        evict(QString());
+        endChange();
+    }
+}
+
+void ComicCache::load()
+{
+    if (mLoaded) {
+        return;
+    }
+    mLoaded = true;
+
+    QDir().mkpath(mDir);
+
+    if (!mLock.tryLock(LOCK_TIMEOUT)) {
+        qWarning() << "Could not lock the comic cache index" << mDir;
+        return;
+    }
+
+    if (!QFile::exists(mDir + QLatin1String("index"))) {
+        importLegacyCache();
+    } else if (!readIndex()) {
+        //e.g. plasmashell got killed while writing, get rid of the broken tail
+        qWarning() << "The comic cache index is damaged, dropping the unreadable part.";
+        compact();
+    }
+    mLock.unlock();
+}
+
+bool ComicCache::readIndex()
+{
+    QFile file(mDir + QLatin1String("index"));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    quint32 magic = 0;
+    quint32 version = 0;
+    quint32 generation = 0;
+    stream >> magic >> version >> generation;
+    if (stream.status() != QDataStream::Ok || magic != INDEX_MAGIC || version != INDEX_VERSION) {
+        qWarning() << "Ignoring comic cache index with unknown format" << file.fileName();
+        return false;
+    }
+
+    if (generation != mGeneration) {
+        //compacted by another process, the new file contains everything known so far
+        reset();
+        mGeneration = generation;
+        mIndexSize = file.pos();
+    } else if (file.size() < mIndexSize || !file.seek(mIndexSize)) {
+        return false;
+    }
+
+    //only the records appended since the last look need to be replayed
+    while (!stream.atEnd()) {
+        if (!readRecord(stream)) {
+            return false;
+        }
+        ++mRecords;
+        mIndexSize = file.pos();
+    }
+    return true;
+}
+
+void ComicCache::reset()
+{
+    mStrips.clear();
+    mComics.clear();
+    mNavigation.clear();
+    mUsage.clear();
+    mSize = 0;
+    mRecords = 0;
+    mIndexSize = 0;
+}
+
+bool ComicCache::beginChange()
+{
+    load();
+
+    if (!mLock.tryLock(LOCK_TIMEOUT)) {
+        qWarning() << "Could not lock the comic cache index" << mDir;
+        return false;
+    }
+
+    //catch up with the other processes first, so that nothing they stored gets lost when compacting
+    if (!readIndex()) {
+        compact();
+    }
+    return true;
+}
+
+void ComicCache::endChange()
+{
+    compactIfNeeded();
+    mLock.unlock();
+}
+
+bool ComicCache::readRecord(QDataStream &stream)
+{
+    quint8 type = 0;
+    QString key;
+    Settings info;
+    stream >> type >> key;
+
+    switch (type) {
+        case StripRecord: {
+            qint64 size = 0;
+            stream >> info >> size;
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            insertStrip(key, info, size);
+            break;
+        }
+        case ComicRecord:
+            stream >> info;
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            mComics[key].info = info;
+            break;
+        case RemoveRecord:
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            //the image file itself is already gone
+            removeStrip(key, false);
+            break;
+        case TouchRecord:
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            touchStrip(key);
+            break;
+        case LinkRecord: {
+            StripLinks links;
+            stream >> links.previous >> links.next;
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            mNavigation[comicName(key)].links[key.mid(key.indexOf(QLatin1Char(':')) + 1)] = links;
+            break;
+        }
+        case BoundsRecord: {
+            NavigationEntry &navigation = mNavigation[key];
+            stream >> navigation.first >> navigation.last >> navigation.lastChecked;
+            if (stream.status() != QDataStream::Ok) {
+                return false;
+            }
+            break;
+        }
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+void ComicCache::importLegacyCache()
+{
+    //strips used to be stored with one conf file per strip and one per comic,
+    //collect them once and replace them with the index
+    QDir dir(mDir);
+    const QStringList confFiles = dir.entryList(QStringList() << QStringLiteral("*.conf"), QDir::Files);
+    const QString encodedSeparator = QString::fromLatin1(QUrl::toPercentEncoding(QStringLiteral(":")));
+    QHash<QString, Settings> legacyStrips;
+    QMultiMap<QDateTime, QString> stripsByTime;
+
+    for (const QString &confFile : confFiles) {
+        if (confFile == QLatin1String("comic_settings.conf")) {
+            continue;
+        }
+
+        const QString encoded = confFile.left(confFile.length() - 5);
+        const QString identifier = QUrl::fromPercentEncoding(encoded.toLatin1());
+        QSettings settings(mDir + confFile, QSettings::IniFormat);
+        Settings info;
+        const QStringList keys = settings.childKeys();
+        for (const QString &key : keys) {
+            if (key != QLatin1String("comics")) {
+                info[key] = settings.value(key).toString();
+            }
+        }
+
+        if (encoded.contains(encodedSeparator)) {
+            const QFileInfo image(mDir + encoded);
+            if (image.exists()) {
+                legacyStrips[identifier] = info;
+                stripsByTime.insert(image.lastModified(), identifier);
+            }
+        } else {
+            mComics[identifier].info = info;
+        }
+    }
+
+    //the modification time is the best guess on how recently a strip was used
+    for (const QString &identifier : qAsConst(stripsByTime)) {
+        insertStrip(identifier, legacyStrips.value(identifier), QFileInfo(imagePath(identifier)).size());
+    }
+
+    compact();
+
+    for (const QString &confFile : confFiles) {
+        if (confFile != QLatin1String("comic_settings.conf")) {
+            dir.remove(confFile);
+        }
+    }
+}
+
+void ComicCache::appendRecord(const QByteArray &record)
+{
+    //opened for each record, another process might have replaced the file in the meantime
+    QFile file(mDir + QLatin1String("index"));
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append) || file.write(record) != record.size()) {
+        qWarning() << "Could not write the comic cache index" << file.fileName();
+        return;
+    }
+    file.close();
+    mIndexSize = file.size();
+    ++mRecords;
+}
+
+void ComicCache::writeStrip(const QString &identifier, const StripEntry &strip)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << quint8(StripRecord) << identifier << strip.info << strip.size;
+    appendRecord(record);
+}
+
+void ComicCache::writeComic(const QString &comicName, const Settings &info)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << quint8(ComicRecord) << comicName << info;
+    appendRecord(record);
+}
+
+void ComicCache::writeRemove(const QString &identifier)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << quint8(RemoveRecord) << identifier;
+    appendRecord(record);
+}
+
+void ComicCache::writeTouch(const QString &identifier)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << quint8(TouchRecord) << identifier;
+    appendRecord(record);
+}
+
+void ComicCache::writeLinks(const QString &identifier, const StripLinks &links)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << quint8(LinkRecord) << identifier << links.previous << links.next;
+    appendRecord(record);
+}
+
+void ComicCache::writeBounds(const QString &comicName, const NavigationEntry &navigation)
+{
+    QByteArray record;
+    QDataStream stream(&record, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_12);
+    stream << quint8(BoundsRecord) << comicName << navigation.first << navigation.last << navigation.lastChecked;
+    appendRecord(record);
+}
+
+void ComicCache::compactIfNeeded()
+{
+    //rewriting is linear in the cache size, so only do it once most of the records are obsolete
+    int live = mComics.count() + mStrips.count() + mNavigation.count();
+    for (const NavigationEntry &navigation : qAsConst(mNavigation)) {
+        live += navigation.links.count();
+    }
+    if (mRecords > 2 * live + 64) {
+        compact();
+    }
+}
+
+void ComicCache::compact()
+{
+    QSaveFile file(mDir + QLatin1String("index"));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write the comic cache index" << file.fileName();
+        return;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_12);
+    //a new generation tells the other processes to read the whole file again
+    const quint32 generation = mGeneration + 1;
+    stream << INDEX_MAGIC << INDEX_VERSION << generation;
+
+    int records = 0;
+    for (QHash<QString, ComicEntry>::const_iterator it = mComics.constBegin(); it != mComics.constEnd(); ++it) {
+        stream << quint8(ComicRecord) << it.key() << it->info;
+        ++records;
+    }
+    //written least recently used first, replaying them restores the global and the per comic order
+    for (const QString &identifier : mUsage) {
+        const StripEntry &strip = mStrips[identifier];
+        stream << quint8(StripRecord) << identifier << strip.info << strip.size;
+        ++records;
+    }
+    for (QHash<QString, NavigationEntry>::const_iterator it = mNavigation.constBegin(); it != mNavigation.constEnd(); ++it) {
+        stream << quint8(BoundsRecord) << it.key() << it->first << it->last << it->lastChecked;
+        ++records;
+        for (QHash<QString, StripLinks>::const_iterator link = it->links.constBegin(); link != it->links.constEnd(); ++link) {
+            stream << quint8(LinkRecord) << (it.key() + QLatin1Char(':') + link.key()) << link->previous << link->next;
+            ++records;
+        }
+    }
+
+    const qint64 size = file.pos();
+    if (file.commit()) {
+        mRecords = records;
+        mGeneration = generation;
+        mIndexSize = size;
+    } else {
+        qWarning() << "Could not write the comic cache index" << file.fileName();
+    }
+}
@@ -0,0 +1,265 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef COMICCACHE_H
+#define COMICCACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QLockFile>
+#include <QString>
+#include <QStringList>
+
+#include <list>
+
+class QDataStream;
+class QImage;
+
+/**
+ * This class manages the on-disk cache of the comic engine.
+ *
+ * All metadata of the cached strips and comics lives in one index file
+ * per engine, which is read once and then kept in memory, so lookups
+ * never touch the disk. Changes are appended to the index as journal
+ * records, the file is compacted once enough records became obsolete.
+ * All plasma processes of a user share the index, so a change is made
+ * while holding a lock file, after replaying what the others appended.
+ *
+ * The images themselves are stored next to the index, one file per strip.
+ * Strips are evicted least recently used first, either once a comic has more
+ * than maxComicLimit() strips or once all strips together exceed maxCacheSize().
+ *
+ * Independent of the images the cache remembers how the strips of a comic
+ * are linked, so navigation and ranges can be planned without asking
+ * the website again.
+ */
+class ComicCache
+{
+    public:
+        /**
+         * Map of keys and values stored for a strip or a comic
+         */
+        typedef QHash<QString, QString> Settings;
+
+        /**
+         * Returns the cache of this process.
+         */
+        static ComicCache *self();
+
+
+        /**
+         * Returns whether a strip with the given @p identifier is cached.
+         */
+        bool contains(const QString &identifier);
+
+        /**
+         * Returns the strip specific information stored for @p identifier.
+         */
+        Settings stripInfo(const QString &identifier);
+
+        /**
+         * Returns the comic specific information stored for @p comicName,
+         * e.g. the title or the last cached strip identifier.
+         */
+        Settings comicInfo(const QString &comicName);
+
+        /**
+         * Returns the location of the image file for @p identifier.
+         */
+        QString imagePath(const QString &identifier) const;
+
+        /**
+         * Returns the location of the image of @p identifier downscaled to @p width,
+         * see variantWidth(). Such variants are removed together with the strip,
+         * they are not part of the size of the cache.
+         */
+        QString variantPath(const QString &identifier, int width) const;
+
+        /**
+         * Returns the width of the variant to use for showing a strip @p width pixels
+         * wide, or 0 if the original should be used instead.
+         */
+        static int variantWidth(int width);
+
+        /**
+         * Stores the given @p comic with the given @p identifier in the cache.
+         * @p info is split into comic and strip specific information.
+         * If @p data is not empty it is written as is, keeping its format,
+         * otherwise @p comic gets encoded as PNG.
+         */
+        bool store(const QString &identifier, const QImage &comic, const Settings &info, const QByteArray &data = QByteArray());
+
+        /**
+         * Removes the strip @p identifier including its image from the cache.
+         */
+        void remove(const QString &identifier);
+
+        /**
+         * Marks the strip @p identifier as used, so that it is evicted last.
+         */
+        void touch(const QString &identifier);
+
+        /**
+         * Returns the size in bytes of all cached images.
+         */
+        qint64 size();
+
+        /**
+         * Returns the number of cached strips.
+         */
+        int stripCount();
+
+        /**
+         * Returns the number of comics with cached strips.
+         */
+        int comicCount();
+
+        /**
+         * Remembers that the strip @p identifier links to the strips with the
+         * identifier suffixes @p previous and @p next, empty if there is none.
+         */
+        void storeLinks(const QString &identifier, const QString &previous, const QString &next);
+
+        /**
+         * Remembers the first and the most recent identifier suffix of @p comicName,
+         * empty values leave the known ones untouched.
+         */
+        void storeBounds(const QString &comicName, const QString &first, const QString &last);
+
+        /**
+         * Returns the identifier suffix of the first strip of @p comicName, if known.
+         */
+        QString firstStrip(const QString &comicName);
+
+        /**
+         * Returns the identifier suffix of the most recent strip of @p comicName, if known.
+         */
+        QString lastStrip(const QString &comicName);
+
+        /**
+         * Returns when the most recent strip of @p comicName was seen the last time.
+         */
+        QDateTime lastChecked(const QString &comicName);
+
+        /**
+         * Returns the identifier suffixes of @p comicName in their order,
+         * as far as they are connected by known links.
+         */
+        QStringList strips(const QString &comicName);
+
+        /**
+         * Returns the maximum number of cached strips per comic, 0 means that there is no limit
+         */
+        int maxComicLimit();
+
+        /**
+         * Sets the maximum number of cached strips per comic
+         */
+        void setMaxComicLimit(int limit);
+
+        /**
+         * Returns the maximum size in bytes of all cached images, 0 means that there is no limit
+         */
+        qint64 maxCacheSize();
+
+        /**
+         * Sets the maximum size in bytes of all cached images
+         */
+        void setMaxCacheSize(qint64 size);
+
+    private:
+        ComicCache();
+
+        enum RecordType {
+            StripRecord = 1,
+            ComicRecord,
+            RemoveRecord,
+            TouchRecord,
+            LinkRecord,
+            BoundsRecord
+        };
+
+        typedef std::list<QString> UsageList; ///< least recently used first
+
+        struct StripEntry {
+            Settings info;
+            qint64 size;
+            UsageList::iterator usage;
+            UsageList::iterator comicUsage;
+        };
+
+        struct ComicEntry {
+            Settings info;
+            UsageList strips;
+        };
+
+        struct StripLinks {
+            QString previous;
+            QString next;
+        };
+
+        struct NavigationEntry {
+            QHash<QString, StripLinks> links; ///< by identifier suffix
+            QString first;
+            QString last;
+            QDateTime lastChecked;
+        };
+
+        void load();
+        void importLegacyCache();
+        bool readIndex();
+        bool readRecord(QDataStream &stream);
+        void reset();
+        bool beginChange();
+        void endChange();
+        void appendRecord(const QByteArray &record);
+        void writeStrip(const QString &identifier, const StripEntry &strip);
+        void writeComic(const QString &comicName, const Settings &info);
+        void writeRemove(const QString &identifier);
+        void writeTouch(const QString &identifier);
+        void writeLinks(const QString &identifier, const StripLinks &links);
+        void writeBounds(const QString &comicName, const NavigationEntry &navigation);
+        void compactIfNeeded();
+        void compact();
+        qint64 writeImage(const QString &identifier, const QImage &comic, const QByteArray &data);
+        void insertStrip(const QString &identifier, const Settings &info, qint64 size);
+        void touchStrip(const QString &identifier);
+        void removeStrip(const QString &identifier, bool removeFile);
+        void removeVariants(const QString &identifier);
+        void evict(const QString &keep);
+        static QString comicName(const QString &identifier);
+        static QStringList followLinks(const QHash<QString, StripLinks> &links, QString suffix);
+        static bool isComicKey(const QString &key);
+
+        QString mDir;
+        QLockFile mLock;
+        bool mLoaded;
+        int mRecords;
+        quint32 mGeneration;
+        qint64 mIndexSize; ///< bytes of the index already replayed
+        int mMaxComicLimit;
+        qint64 mMaxCacheSize;
+        qint64 mSize;
+        QHash<QString, StripEntry> mStrips;
+        QHash<QString, ComicEntry> mComics;
+        QHash<QString, NavigationEntry> mNavigation;
+        UsageList mUsage;
+};
+
+#endif
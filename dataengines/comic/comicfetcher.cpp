@@ -0,0 +1,380 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "comicfetcher.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QSet>
+#include <QStandardPaths>
+#include <QDebug>
+
+#include <KIO/Job>
+#include <KIO/StoredTransferJob>
+
+// like browsers doing HTTP/1.1, comic sites tend to throttle clients opening more
+static const int MAX_JOBS_PER_HOST = 2;
+static const quint32 PAGE_MAGIC = 0x434f4d50; // "COMP"
+static const int MAX_STORED_PAGES = 100;
+
+static bool isHttp(const QUrl &url)
+{
+    return url.scheme() == QLatin1String("http") || url.scheme() == QLatin1String("https");
+}
+
+ComicFetcher::Priority ComicFetcher::Fetch::priority() const
+{
+    Priority result = Archive;
+    for (const Waiter &waiter : waiters) {
+        if (waiter.requester && waiter.priority < result) {
+            result = waiter.priority;
+        }
+    }
+    return result;
+}
+
+ComicFetcher *ComicFetcher::self()
+{
+    //owned by the application, providers destroyed after it must not use it anymore
+    static QPointer<ComicFetcher> fetcher;
+    static bool created = false;
+    if (!created && QCoreApplication::instance()) {
+        created = true;
+        fetcher = new ComicFetcher;
+    }
+    return fetcher;
+}
+
+ComicFetcher::ComicFetcher()
+    : QObject(QCoreApplication::instance()),
+      mOrder(0),
+      mPageDir(QStandardPaths::writableLocation(QStandardPaths::GenericDataLocation) + QLatin1String("/plasma_engine_comic/pages/")),
+      mStoredPages(-1)
+{
+}
+
+ComicFetcher::~ComicFetcher()
+{
+    qDeleteAll(mFetches);
+}
+
+int ComicFetcher::maxJobsPerHost()
+{
+    return MAX_JOBS_PER_HOST;
+}
+
+QString ComicFetcher::keyFor(const QUrl &url, bool reload, const QMap<QString, QString> &metaData)
+{
+    //a running download cannot be switched to reloading anymore, so those are not merged
+    QString key = url.toString() + (reload ? QLatin1String("\nreload") : QString());
+    QMap<QString, QString>::const_iterator it;
+    for (it = metaData.constBegin(); it != metaData.constEnd(); ++it) {
+        key += QLatin1Char('\n') + it.key() + QLatin1Char('=') + it.value();
+    }
+    return key;
+}
+
+void ComicFetcher::fetch(QObject *requester, const QUrl &url, bool reload, const QMap<QString, QString> &metaData,
+                         Priority priority, const Handler &handler, const StartHandler &started)
+{
+    Waiter waiter;
+    waiter.requester = requester;
+    waiter.priority = priority;
+    waiter.handler = handler;
+    waiter.started = started;
+
+    const QString key = keyFor(url, reload, metaData);
+    Fetch *fetch = mFetches.value(key);
+    if (fetch) {
+        //someone else is already fetching it, wait for the same bytes
+        fetch->waiters << waiter;
+        if (fetch->job && started) {
+            started();
+        }
+        return;
+    }
+
+    fetch = new Fetch;
+    fetch->url = url;
+    fetch->host = url.host().toLower();
+    fetch->reload = reload;
+    fetch->metaData = metaData;
+    fetch->waiters << waiter;
+    fetch->job = nullptr;
+    fetch->order = mOrder++;
+    fetch->conditional = false;
+    fetch->notified = false;
+    mFetches[key] = fetch;
+
+    startPending(fetch->host);
+}
+
+void ComicFetcher::setPriority(QObject *requester, Priority priority)
+{
+    for (Fetch *fetch : qAsConst(mFetches)) {
+        for (Waiter &waiter : fetch->waiters) {
+            if (waiter.requester == requester) {
+                waiter.priority = priority;
+            }
+        }
+    }
+}
+
+void ComicFetcher::cancel(QObject *requester)
+{
+    QSet<QString> hosts;
+    QHash<QString, Fetch*>::iterator it = mFetches.begin();
+    while (it != mFetches.end()) {
+        Fetch *fetch = it.value();
+        QList<Waiter>::iterator waiter = fetch->waiters.begin();
+        while (waiter != fetch->waiters.end()) {
+            if (!waiter->requester || waiter->requester == requester) {
+                waiter = fetch->waiters.erase(waiter);
+            } else {
+                ++waiter;
+            }
+        }
+
+        if (!fetch->waiters.isEmpty()) {
+            ++it;
+            continue;
+        }
+
+        //nobody is interested anymore
+        if (fetch->job) {
+            mJobs.remove(fetch->job);
+            fetch->job->kill();
+            --mRunning[fetch->host];
+            hosts << fetch->host;
+        }
+        delete fetch;
+        it = mFetches.erase(it);
+    }
+
+    for (const QString &host : qAsConst(hosts)) {
+        startPending(host);
+    }
+}
+
+void ComicFetcher::startPending(const QString &host)
+{
+    while (mRunning.value(host) < MAX_JOBS_PER_HOST) {
+        Fetch *next = nullptr;
+        Priority nextPriority = Archive;
+        for (Fetch *fetch : qAsConst(mFetches)) {
+            if (fetch->job || fetch->host != host) {
+                continue;
+            }
+            const Priority priority = fetch->priority();
+            if (!next || priority < nextPriority || (priority == nextPriority && fetch->order < next->order)) {
+                next = fetch;
+                nextPriority = priority;
+            }
+        }
+
+        if (!next) {
+            break;
+        }
+        start(next);
+    }
+
+    if (!mRunning.value(host)) {
+        mRunning.remove(host);
+    }
+}
+
+void ComicFetcher::start(Fetch *fetch)
+{
+    QMap<QString, QString> metaData = fetch->metaData;
+
+    //pages are always asked for again, but only sent if they changed
+    fetch->conditional = false;
+    if (fetch->reload && isHttp(fetch->url)) {
+        StoredPage page;
+        if (loadPage(fetch->url, &page)) {
+            QStringList headers;
+            if (!metaData.value(QLatin1String("customHTTPHeader")).isEmpty()) {
+                headers << metaData.value(QLatin1String("customHTTPHeader"));
+            }
+            if (!page.etag.isEmpty()) {
+                headers << QLatin1String("If-None-Match: ") + page.etag;
+            }
+            if (!page.lastModified.isEmpty()) {
+                headers << QLatin1String("If-Modified-Since: ") + page.lastModified;
+            }
+            metaData[QLatin1String("customHTTPHeader")] = headers.join(QLatin1String("\r\n"));
+            fetch->conditional = true;
+        }
+        metaData[QLatin1String("PropagateHttpHeader")] = QLatin1String("true");
+    }
+
+    //for webpages we always reload, making sure, that changes are recognised
+    //for images use cached information if available
+    KIO::StoredTransferJob *job = KIO::storedGet(fetch->url, fetch->reload ? KIO::Reload : KIO::NoReload, KIO::HideProgressInfo);
+    QMap<QString, QString>::const_iterator it;
+    for (it = metaData.constBegin(); it != metaData.constEnd(); ++it) {
+        job->addMetaData(it.key(), it.value());
+    }
+    connect(job, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+    fetch->job = job;
+    mJobs[job] = keyFor(fetch->url, fetch->reload, fetch->metaData);
+    ++mRunning[fetch->host];
+
+    if (fetch->notified) {
+        return;
+    }
+    fetch->notified = true;
+    const QList<Waiter> waiters = fetch->waiters;
+    for (const Waiter &waiter : waiters) {
+        if (waiter.requester && waiter.started) {
+            waiter.started();
+        }
+    }
+}
+
+void ComicFetcher::jobDone(KJob *job)
+{
+    if (!mJobs.contains(job)) {
+        return;
+    }
+
+    const QString key = mJobs.take(job);
+    Fetch *fetch = mFetches.take(key);
+    const QString host = fetch->host;
+    --mRunning[host];
+
+    //handlers may request further pages, those must not join this finished fetch
+    QString errorText;
+    QByteArray data;
+    if (job->error()) {
+        errorText = job->errorText();
+        if (errorText.isEmpty()) {
+            errorText = QStringLiteral("Error %1").arg(job->error());
+        }
+    } else {
+        KIO::StoredTransferJob *storedJob = static_cast<KIO::StoredTransferJob*>(job);
+        data = storedJob->data();
+        if (fetch->reload && isHttp(fetch->url)) {
+            StoredPage page;
+            if (storedJob->queryMetaData(QLatin1String("responsecode")).toInt() != 304) {
+                storePage(fetch->url, storedJob->queryMetaData(QLatin1String("HTTP-Headers")), data);
+            } else if (!fetch->conditional) {
+                qWarning() << "Unexpected response" << fetch->url;
+            } else if (loadPage(fetch->url, &page)) {
+                //not modified, the stored body is still correct
+                data = page.body;
+            } else {
+                //the stored page vanished in the meantime, ask again without validators
+                QFile::remove(pagePath(fetch->url));
+                fetch->job = nullptr;
+                mFetches[key] = fetch;
+                startPending(host);
+                return;
+            }
+        }
+    }
+
+    for (const Waiter &waiter : qAsConst(fetch->waiters)) {
+        if (waiter.requester) {
+            waiter.handler(data, errorText);
+        }
+    }
+    delete fetch;
+
+    startPending(host);
+}
+
+QString ComicFetcher::pagePath(const QUrl &url) const
+{
+    return mPageDir + QString::fromLatin1(QCryptographicHash::hash(url.toEncoded(), QCryptographicHash::Sha1).toHex());
+}
+
+bool ComicFetcher::loadPage(const QUrl &url, StoredPage *page) const
+{
+    QFile file(pagePath(url));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic;
+    QUrl storedUrl;
+    stream >> magic;
+    if (magic != PAGE_MAGIC) {
+        return false;
+    }
+    stream >> storedUrl >> page->etag >> page->lastModified >> page->body;
+    return stream.status() == QDataStream::Ok && storedUrl == url;
+}
+
+void ComicFetcher::storePage(const QUrl &url, const QString &headers, const QByteArray &body)
+{
+    StoredPage page;
+    const QStringList lines = headers.split(QLatin1Char('\n'));
+    for (const QString &line : lines) {
+        const int index = line.indexOf(QLatin1Char(':'));
+        const QString name = line.left(index).trimmed();
+        if (name.compare(QLatin1String("ETag"), Qt::CaseInsensitive) == 0) {
+            page.etag = line.mid(index + 1).trimmed();
+        } else if (name.compare(QLatin1String("Last-Modified"), Qt::CaseInsensitive) == 0) {
+            page.lastModified = line.mid(index + 1).trimmed();
+        }
+    }
+
+    const QString path = pagePath(url);
+    const bool existed = QFile::exists(path);
+    if (page.etag.isEmpty() && page.lastModified.isEmpty()) {
+        //nothing to revalidate with
+        if (existed && QFile::remove(path) && mStoredPages > 0) {
+            --mStoredPages;
+        }
+        return;
+    }
+
+    QDir().mkpath(mPageDir);
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not store the page" << url;
+        return;
+    }
+    QDataStream stream(&file);
+    stream << PAGE_MAGIC << url << page.etag << page.lastModified << body;
+    if (!file.commit() || existed) {
+        return;
+    }
+
+    //only keep the pages that were asked for most recently
+    if (mStoredPages == -1) {
+        mStoredPages = QDir(mPageDir).entryList(QDir::Files).count();
+    } else {
+        ++mStoredPages;
+    }
+    if (mStoredPages > MAX_STORED_PAGES) {
+        QDir dir(mPageDir);
+        const QStringList files = dir.entryList(QDir::Files, QDir::Time);
+        for (int i = MAX_STORED_PAGES * 3 / 4; i < files.count(); ++i) {
+            dir.remove(files[i]);
+        }
+        mStoredPages = qMin(files.count(), MAX_STORED_PAGES * 3 / 4);
+    }
+}
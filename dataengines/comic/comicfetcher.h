@@ -0,0 +1,151 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef COMICFETCHER_H
+#define COMICFETCHER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QUrl>
+
+#include <functional>
+
+class KJob;
+
+/**
+ * This class schedules all downloads of the comic providers of a process.
+ *
+ * Requests for the same url are merged while one of them is in flight, all
+ * requesters get the same bytes. Requests reloading the url are only merged
+ * with other requests reloading it. Only a few downloads per host run at once,
+ * the others wait in a queue ordered by their priority.
+ *
+ * Pages that are always reloaded are revalidated: their ETag and Last-Modified
+ * validators are stored together with the body, the next request for that url
+ * is conditional and an unchanged page is taken from the store.
+ */
+class ComicFetcher : public QObject
+{
+        Q_OBJECT
+
+    public:
+        /**
+         * Priorities of the requests, lower values are started first
+         */
+        enum Priority {
+            Interactive = 0, ///< the strip that is displayed
+            Prefetch,        ///< strips that might be displayed soon
+            Archive          ///< strips that are downloaded in bulk
+        };
+
+        /**
+         * Called once the download finished, @p errorText is empty on success
+         */
+        typedef std::function<void (const QByteArray &data, const QString &errorText)> Handler;
+
+        /**
+         * Called once the download of a queued request actually started
+         */
+        typedef std::function<void ()> StartHandler;
+
+        /**
+         * Returns the fetcher of this process, nullptr once the application
+         * got destroyed.
+         */
+        static ComicFetcher *self();
+
+        /**
+         * Downloads @p url for @p requester, @p handler is called unless the requester
+         * got destroyed or cancelled its requests in the meantime.
+         *
+         * @param reload whether the page has to be fetched again instead of using the http cache,
+         *               requests only get merged if it matches
+         * @param metaData meta data passed to KIO, requests only get merged if it matches
+         */
+        void fetch(QObject *requester, const QUrl &url, bool reload, const QMap<QString, QString> &metaData,
+                   Priority priority, const Handler &handler, const StartHandler &started = StartHandler());
+
+        /**
+         * Changes the priority of all pending requests of @p requester.
+         */
+        void setPriority(QObject *requester, Priority priority);
+
+        /**
+         * Drops all requests of @p requester, downloads nobody waits for anymore are aborted.
+         */
+        void cancel(QObject *requester);
+
+        /**
+         * Maximum number of simultaneous downloads per host
+         */
+        static int maxJobsPerHost();
+
+    private Q_SLOTS:
+        void jobDone(KJob *job);
+
+    private:
+        struct Waiter {
+            QPointer<QObject> requester;
+            Priority priority;
+            Handler handler;
+            StartHandler started;
+        };
+
+        struct Fetch {
+            QUrl url;
+            QString host;
+            bool reload;
+            QMap<QString, QString> metaData;
+            QList<Waiter> waiters;
+            KJob *job;
+            quint64 order;
+            bool conditional;
+            bool notified;
+
+            Priority priority() const;
+        };
+
+        struct StoredPage {
+            QString etag;
+            QString lastModified;
+            QByteArray body;
+        };
+
+        ComicFetcher();
+        ~ComicFetcher() override;
+
+        static QString keyFor(const QUrl &url, bool reload, const QMap<QString, QString> &metaData);
+        void start(Fetch *fetch);
+        void startPending(const QString &host);
+        QString pagePath(const QUrl &url) const;
+        bool loadPage(const QUrl &url, StoredPage *page) const;
+        void storePage(const QUrl &url, const QString &headers, const QByteArray &body);
+
+        QHash<QString, Fetch*> mFetches;
+        QHash<KJob*, QString> mJobs;
+        QHash<QString, int> mRunning;
+        quint64 mOrder;
+        QString mPageDir;
+        int mStoredPages;
+};
+
+#endif
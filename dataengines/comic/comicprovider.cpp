@@ -17,13 +17,16 @@
  */
 
 #include "comicprovider.h"
+#include "comicfetcher.h"
+#include "comicstatistics.h"
 
+#include <QElapsedTimer>
+#include <QSharedPointer>
 #include <QTimer>
 #include <QUrl>
 #include <QDebug>
 
 #include <KIO/Job>
-#include <KIO/StoredTransferJob>
 #include <KPluginMetaData>
 
 class ComicProvider::Private
@@ -33,7 +36,10 @@ class ComicProvider::Private
             : mParent(parent),
               mIsCurrent(false),
               mFirstStripNumber(1),
-              mComicDescription(data)
+              mComicDescription(data),
+              mPriority(InteractivePriority),
+              mQueued(0),
+              mActive(0)
         {
             mTimer = new QTimer(parent);
             mTimer->setSingleShot(true);
@@ -41,16 +47,6 @@ class ComicProvider::Private
             connect(mTimer, SIGNAL(timeout()), mParent, SLOT(slotTimeout()));
         }
 
-        void jobDone(KJob *job)
-        {
-            if (job->error()) {
-                mParent->pageError(job->property("uid").toInt(), job->errorText());
-            } else {
-                KIO::StoredTransferJob *storedJob = qobject_cast<KIO::StoredTransferJob*>(job);
-                mParent->pageRetrieved(job->property("uid").toInt(), storedJob->data());
-            }
-        }
-
         void slotRedirection(KIO::Job *job, QUrl newUrl)
         {
             slotRedirection(job, QUrl(), newUrl);
@@ -66,6 +62,8 @@ class ComicProvider::Private
 
         void slotRedirectionDone(KJob *job)
         {
+            --mActive;
+
             if (job->error()) {
                 qDebug() << "Redirection job with id" << job->property("uid").toInt() <<  "finished with an error.";
             }
@@ -80,6 +78,7 @@ class ComicProvider::Private
         void slotTimeout()
         {
             //operation took too long, abort it
+            ComicStatistics::self()->addTimeout(mParent->pluginName());
             emit mParent->error(mParent);
         }
 
@@ -102,6 +101,9 @@ class ComicProvider::Private
         int mRequestedNumber;
         int mFirstStripNumber;
         KPluginMetaData mComicDescription;
+        RequestPriority mPriority;
+        int mQueued;
+        int mActive;
         QTimer *mTimer;
         QHash< KJob*, QUrl > mRedirections;
 };
@@ -133,6 +135,10 @@ ComicProvider::ComicProvider(QObject *parent, const QVariantList &args)
 
 ComicProvider::~ComicProvider()
 {
+    //the engine might be torn down after the application
+    if (ComicFetcher *fetcher = ComicFetcher::self()) {
+        fetcher->cancel(this);
+    }
     delete d;
 }
 
@@ -172,6 +178,19 @@ bool ComicProvider::isCurrent() const
     return d->mIsCurrent;
 }
 
+void ComicProvider::setRequestPriority(RequestPriority priority)
+{
+    d->mPriority = priority;
+    if (ComicFetcher *fetcher = ComicFetcher::self()) {
+        fetcher->setPriority(this, static_cast<ComicFetcher::Priority>(priority));
+    }
+}
+
+ComicProvider::RequestPriority ComicProvider::requestPriority() const
+{
+    return d->mPriority;
+}
+
 QDate ComicProvider::requestedDate() const
 {
     return d->mRequestedDate;
@@ -235,30 +254,37 @@ QString ComicProvider::requestedComicName() const
 
 void ComicProvider::requestPage(const QUrl &url, int id, const MetaInfos &infos)
 {
-    //each request restarts the timer
-    d->mTimer->start();
-
     if (id == Image) {
         d->mImageUrl = url;
     }
 
-    KIO::StoredTransferJob *job;
-    if (id == Image) {
-        //use cached information for the image if available
-        job = KIO::storedGet(url, KIO::NoReload, KIO::HideProgressInfo);
-    } else {
-        //for webpages we always reload, making sure, that changes are recognised
-        job = KIO::storedGet(url, KIO::Reload, KIO::HideProgressInfo);
-    }
-    job->setProperty("uid", id);
-    connect(job, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
-
-    if (!infos.isEmpty()) {
-        QMapIterator<QString, QString> it(infos);
-        while (it.hasNext()) {
-            it.next();
-            job->addMetaData(it.key(), it.value());
-        }
+    //for webpages we always reload, making sure, that changes are recognised
+    ++d->mQueued;
+    QSharedPointer<QElapsedTimer> latency(new QElapsedTimer);
+    ComicFetcher::self()->fetch(this, url, id != Image, infos, static_cast<ComicFetcher::Priority>(d->mPriority),
+        [this, id, latency](const QByteArray &data, const QString &errorText) {
+            --d->mActive;
+            if (!d->mActive && d->mQueued) {
+                d->mTimer->stop();
+            }
+            if (errorText.isEmpty()) {
+                ComicStatistics::self()->addDownload(pluginName(), data.size(), latency->elapsed());
+                pageRetrieved(id, data);
+            } else {
+                pageError(id, errorText);
+            }
+        },
+        [this, latency]() {
+            //the timer only runs while downloads are actually running, each one restarts it
+            --d->mQueued;
+            ++d->mActive;
+            d->mTimer->start();
+            latency->start();
+        });
+
+    //waiting for other downloads to finish is no timeout
+    if (!d->mActive) {
+        d->mTimer->stop();
     }
 }
 
@@ -269,6 +295,7 @@ void ComicProvider::requestRedirectedUrl(const QUrl &url, int id, const MetaInfo
 
     KIO::MimetypeJob *job = KIO::mimetype(url, KIO::HideProgressInfo);
     job->setProperty("uid", id);
+    ++d->mActive;
     d->mRedirections[job] = url;
     connect(job, SIGNAL(redirection(KIO::Job*,QUrl)), this, SLOT(slotRedirection(KIO::Job*,QUrl)));
     connect(job, SIGNAL(permanentRedirection(KIO::Job*,QUrl,QUrl)), this, SLOT(slotRedirection(KIO::Job*,QUrl,QUrl)));
@@ -324,6 +351,11 @@ KPluginMetaData ComicProvider::description() const
     return d->mComicDescription;
 }
 
+QByteArray ComicProvider::imageData() const
+{
+    return QByteArray();
+}
+
 QUrl ComicProvider::shopUrl() const
 {
     return QUrl();
@@ -53,6 +53,16 @@ class PLASMA_COMIC_EXPORT ComicProvider : public QObject
             User
         };
 
+        /**
+         * Describes how urgent the downloads of a request are,
+         * see ComicFetcher.
+         */
+        enum RequestPriority {
+            InteractivePriority = 0, ///< The strip is displayed
+            PrefetchPriority,        ///< The strip might be displayed soon
+            ArchivePriority          ///< The strip is downloaded in bulk
+        };
+
         /**
          * Creates a new comic provider.
          *
@@ -104,6 +114,16 @@ class PLASMA_COMIC_EXPORT ComicProvider : public QObject
          */
         virtual QImage image() const = 0;
 
+        /**
+         * Returns the encoded image exactly as it was downloaded, so that it can
+         * be stored without encoding it again.
+         *
+         * The default implementation returns an empty QByteArray, which is also
+         * what providers should return if the image has been modified after
+         * downloading it; image() is used then.
+         */
+        virtual QByteArray imageData() const;
+
         /**
          * Returns the identifier of the comic request.
          */
@@ -175,6 +195,16 @@ class PLASMA_COMIC_EXPORT ComicProvider : public QObject
          */
         bool isCurrent() const;
 
+        /**
+         * Sets the priority of the downloads of this request (only used internally).
+         */
+        void setRequestPriority(RequestPriority priority);
+
+        /**
+         * Returns the priority of the downloads of this request (only used internally).
+         */
+        RequestPriority requestPriority() const;
+
     Q_SIGNALS:
         /**
          * This signal is emitted whenever a request has been finished
@@ -288,7 +318,6 @@ class PLASMA_COMIC_EXPORT ComicProvider : public QObject
         class Private;
         Private* const d;
 
-        Q_PRIVATE_SLOT(d, void jobDone(KJob*))
         Q_PRIVATE_SLOT(d, void slotRedirection(KIO::Job*, QUrl))
         Q_PRIVATE_SLOT(d, void slotRedirection(KIO::Job*, QUrl, QUrl))
         Q_PRIVATE_SLOT(d, void slotRedirectionDone(KJob*))
@@ -0,0 +1,431 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "comicproviderjson.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QTextCodec>
+#include <QTextDocumentFragment>
+#include <QTimer>
+
+struct ComicManifest
+{
+    QDateTime modified;
+    QString websiteUrl;
+    QString currentUrl;
+    QString shopUrl;
+    QString author;
+    QByteArray textCodec;
+    QString firstIdentifier;
+    QString dateFormat;
+    QList<int> weekdays;
+    bool isLeftToRight;
+    bool isTopToBottom;
+    QHash<QString, QRegularExpression> rules;
+};
+
+static QSharedPointer<const ComicManifest> loadManifest(const QString &path)
+{
+    //manifests by path, they are parsed again only once they have been modified
+    static QHash<QString, QSharedPointer<const ComicManifest> > manifests;
+
+    const QFileInfo info(path);
+    QHash<QString, QSharedPointer<const ComicManifest> >::const_iterator it = manifests.constFind(path);
+    if (it != manifests.constEnd() && (*it)->modified == info.lastModified()) {
+        return *it;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Could not open the comic manifest" << path;
+        return QSharedPointer<const ComicManifest>();
+    }
+
+    QJsonParseError error;
+    const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (!document.isObject()) {
+        qWarning() << "Could not parse the comic manifest" << path << ":" << error.errorString();
+        return QSharedPointer<const ComicManifest>();
+    }
+
+    const QJsonObject object = document.object();
+    QSharedPointer<ComicManifest> manifest(new ComicManifest);
+    manifest->modified = info.lastModified();
+    manifest->websiteUrl = object.value(QLatin1String("websiteUrl")).toString();
+    manifest->currentUrl = object.value(QLatin1String("currentUrl")).toString();
+    if (manifest->currentUrl.isEmpty()) {
+        manifest->currentUrl = QString(manifest->websiteUrl).replace(QLatin1String("%{identifier}"), QString());
+    }
+    manifest->shopUrl = object.value(QLatin1String("shopUrl")).toString();
+    manifest->author = object.value(QLatin1String("author")).toString();
+    manifest->textCodec = object.value(QLatin1String("textCodec")).toString().toLatin1();
+    manifest->firstIdentifier = object.value(QLatin1String("firstIdentifier")).toVariant().toString();
+    manifest->dateFormat = object.value(QLatin1String("dateFormat")).toString(QStringLiteral("yyyy-MM-dd"));
+    const QJsonArray weekdays = object.value(QLatin1String("weekdays")).toArray();
+    for (const QJsonValue &weekday : weekdays) {
+        manifest->weekdays << weekday.toInt();
+    }
+    manifest->isLeftToRight = object.value(QLatin1String("leftToRight")).toBool(true);
+    manifest->isTopToBottom = object.value(QLatin1String("topToBottom")).toBool(true);
+
+    //compiled once, every strip of the comic uses the same expressions
+    const QJsonObject rules = object.value(QLatin1String("rules")).toObject();
+    for (QJsonObject::const_iterator rule = rules.constBegin(); rule != rules.constEnd(); ++rule) {
+        QRegularExpression expression(rule.value().toString());
+        if (!expression.isValid()) {
+            qWarning() << "Invalid rule" << rule.key() << "in the comic manifest" << path << ":" << expression.errorString();
+            return QSharedPointer<const ComicManifest>();
+        }
+        expression.optimize();
+        manifest->rules.insert(rule.key(), expression);
+    }
+
+    if (manifest->websiteUrl.isEmpty() || !manifest->rules.contains(QLatin1String("image"))) {
+        qWarning() << "The comic manifest" << path << "needs at least a websiteUrl and an image rule.";
+        return QSharedPointer<const ComicManifest>();
+    }
+
+    manifests.insert(path, manifest);
+    return manifest;
+}
+
+static QHash<QString, int> &lastNumbers()
+{
+    //most recent strip of the Number comics, refreshed whenever their current strip is fetched
+    static QHash<QString, int> numbers;
+    return numbers;
+}
+
+ComicProviderJson::ComicProviderJson(QObject *parent, const QVariantList &args)
+    : ComicProvider(parent, args),
+      mManifest(loadManifest(args.value(3).toString()))
+{
+    QTimer::singleShot(0, this, SLOT(start()));
+}
+
+ComicProviderJson::~ComicProviderJson()
+{
+}
+
+void ComicProviderJson::start()
+{
+    if (!mManifest) {
+        emit error(this);
+        return;
+    }
+
+    //without a date the most recent strip can only be known from its page
+    if (isCurrent() && identifierType() != DateIdentifier && !mManifest->rules.contains(QLatin1String("identifier"))) {
+        qWarning() << "The comic manifest of" << identifier() << "needs an identifier rule for its most recent strip.";
+        emit error(this);
+        return;
+    }
+
+    setComicAuthor(mManifest->author);
+    switch (identifierType()) {
+        case DateIdentifier:
+            mIdentifier = requestedDate();
+            mLastIdentifier = QDate::currentDate();
+            setFirstStripDate(QDate::fromString(mManifest->firstIdentifier, Qt::ISODate));
+            break;
+        case NumberIdentifier:
+            mIdentifier = requestedNumber();
+            setFirstStripNumber(mManifest->firstIdentifier.isEmpty() ? 1 : mManifest->firstIdentifier.toInt());
+            if (lastNumbers().contains(pluginName())) {
+                mLastIdentifier = lastNumbers().value(pluginName());
+            }
+            break;
+        case StringIdentifier:
+            mIdentifier = requestedString();
+            break;
+    }
+
+    //for numbers the most recent strip is needed to know where the comic ends,
+    //it is only looked up if no strip of the comic has been requested before
+    if (isCurrent() || (identifierType() == NumberIdentifier && mLastIdentifier.isNull() && mManifest->rules.contains(QLatin1String("identifier")))) {
+        requestPage(QUrl(mManifest->currentUrl), CurrentPage);
+    } else {
+        requestPage(pageUrl(mIdentifier), Page);
+    }
+}
+
+void ComicProviderJson::pageRetrieved(int id, const QByteArray &data)
+{
+    switch (id) {
+        case CurrentPage: {
+            const QString page = decode(data);
+            const QString last = capture(QStringLiteral("identifier"), page);
+            if (!last.isEmpty()) {
+                switch (identifierType()) {
+                    case DateIdentifier: {
+                        const QDate date = QDate::fromString(last, mManifest->dateFormat);
+                        if (date.isValid()) {
+                            mLastIdentifier = date;
+                        }
+                        break;
+                    }
+                    case NumberIdentifier:
+                        mLastIdentifier = last.toInt();
+                        lastNumbers().insert(pluginName(), last.toInt());
+                        break;
+                    case StringIdentifier:
+                        mLastIdentifier = last;
+                        break;
+                }
+            }
+
+            if (isCurrent()) {
+                //the page of the most recent strip is its strip page as well
+                if (!mLastIdentifier.isNull()) {
+                    mIdentifier = mLastIdentifier;
+                } else if (identifierType() != DateIdentifier) {
+                    qWarning() << "Could not find the identifier of the most recent strip of" << identifier();
+                    emit error(this);
+                    return;
+                }
+                processPage(page, QUrl(mManifest->currentUrl));
+            } else {
+                requestPage(pageUrl(mIdentifier), Page);
+            }
+            break;
+        }
+        case Page:
+            processPage(decode(data), pageUrl(mIdentifier));
+            break;
+        case Image:
+            mImageData = data;
+            mImage = QImage::fromData(data);
+            if (mImage.isNull()) {
+                qWarning() << "Could not read the image of" << identifier();
+                emit error(this);
+            } else {
+                emit finished(this);
+            }
+            break;
+    }
+}
+
+void ComicProviderJson::pageError(int id, const QString &message)
+{
+    qWarning() << "Request" << id << "of" << identifier() << "failed:" << message;
+    emit error(this);
+}
+
+void ComicProviderJson::processPage(const QString &page, const QUrl &url)
+{
+    const QString image = capture(QStringLiteral("image"), page);
+    if (image.isEmpty()) {
+        qWarning() << "No image found for" << identifier();
+        emit error(this);
+        return;
+    }
+
+    //the comic went on since its most recent strip was looked up
+    if (identifierType() == NumberIdentifier && !mLastIdentifier.isNull() && mIdentifier.toInt() > mLastIdentifier.toInt()) {
+        mLastIdentifier = mIdentifier;
+        lastNumbers().insert(pluginName(), mIdentifier.toInt());
+    }
+
+    mTitle = capture(QStringLiteral("title"), page);
+    mAdditionalText = capture(QStringLiteral("additionalText"), page);
+    const QString author = capture(QStringLiteral("author"), page);
+    if (!author.isEmpty()) {
+        setComicAuthor(author);
+    }
+    if (identifierType() == StringIdentifier) {
+        mPreviousIdentifier = capture(QStringLiteral("previous"), page);
+        mNextIdentifier = capture(QStringLiteral("next"), page);
+    }
+
+    requestPage(url.resolved(QUrl(image)), Image);
+}
+
+QString ComicProviderJson::capture(const QString &rule, const QString &page) const
+{
+    QHash<QString, QRegularExpression>::const_iterator it = mManifest->rules.constFind(rule);
+    if (it == mManifest->rules.constEnd()) {
+        return QString();
+    }
+
+    const QRegularExpressionMatch match = it->match(page);
+    if (!match.hasMatch()) {
+        return QString();
+    }
+
+    const QString value = match.captured(1).trimmed();
+    //only pay for the html parser if there is something to convert
+    if (value.contains(QLatin1Char('&')) || value.contains(QLatin1Char('<'))) {
+        return QTextDocumentFragment::fromHtml(value).toPlainText().trimmed();
+    }
+    return value;
+}
+
+QString ComicProviderJson::decode(const QByteArray &data) const
+{
+    QTextCodec *codec = nullptr;
+    if (!mManifest->textCodec.isEmpty()) {
+        codec = QTextCodec::codecForName(mManifest->textCodec);
+    }
+    if (!codec) {
+        codec = QTextCodec::codecForHtml(data);
+    }
+    return codec->toUnicode(data);
+}
+
+QUrl ComicProviderJson::pageUrl(const QVariant &identifier) const
+{
+    QString suffix;
+    if (identifierType() == DateIdentifier) {
+        suffix = identifier.toDate().toString(mManifest->dateFormat);
+    } else {
+        suffix = identifier.toString();
+    }
+    return QUrl(QString(mManifest->websiteUrl).replace(QLatin1String("%{identifier}"), suffix));
+}
+
+QString ComicProviderJson::identifierToString(const QVariant &identifier) const
+{
+    if (identifierType() == DateIdentifier) {
+        return identifier.toDate().toString(Qt::ISODate);
+    }
+    return identifier.toString();
+}
+
+QDate ComicProviderJson::stepDate(const QDate &date, int direction) const
+{
+    QDate result = date.addDays(direction);
+    for (int i = 0; i < 7 && !mManifest->weekdays.isEmpty() && !mManifest->weekdays.contains(result.dayOfWeek()); ++i) {
+        result = result.addDays(direction);
+    }
+    return result;
+}
+
+ComicProvider::IdentifierType ComicProviderJson::identifierType() const
+{
+    const QString type = suffixType();
+    if (type == QLatin1String("Date")) {
+        return DateIdentifier;
+    } else if (type == QLatin1String("Number")) {
+        return NumberIdentifier;
+    }
+    return StringIdentifier;
+}
+
+QUrl ComicProviderJson::websiteUrl() const
+{
+    return mManifest ? pageUrl(mIdentifier) : QUrl();
+}
+
+QUrl ComicProviderJson::shopUrl() const
+{
+    return mManifest ? QUrl(mManifest->shopUrl) : QUrl();
+}
+
+QImage ComicProviderJson::image() const
+{
+    return mImage;
+}
+
+QByteArray ComicProviderJson::imageData() const
+{
+    return mImageData;
+}
+
+QString ComicProviderJson::identifier() const
+{
+    return pluginName() + QLatin1Char(':') + identifierToString(mIdentifier);
+}
+
+QString ComicProviderJson::nextIdentifier() const
+{
+    switch (identifierType()) {
+        case DateIdentifier: {
+            const QDate next = stepDate(mIdentifier.toDate(), 1);
+            const QDate last = mLastIdentifier.toDate();
+            if (next.isValid() && (!last.isValid() || next <= last)) {
+                return next.toString(Qt::ISODate);
+            }
+            break;
+        }
+        case NumberIdentifier:
+            if (mLastIdentifier.isNull() || mIdentifier.toInt() < mLastIdentifier.toInt()) {
+                return QString::number(mIdentifier.toInt() + 1);
+            }
+            break;
+        case StringIdentifier:
+            return mNextIdentifier;
+    }
+    return QString();
+}
+
+QString ComicProviderJson::previousIdentifier() const
+{
+    switch (identifierType()) {
+        case DateIdentifier: {
+            const QDate previous = stepDate(mIdentifier.toDate(), -1);
+            if (previous.isValid() && (!firstStripDate().isValid() || previous >= firstStripDate())) {
+                return previous.toString(Qt::ISODate);
+            }
+            break;
+        }
+        case NumberIdentifier:
+            if (mIdentifier.toInt() > firstStripNumber()) {
+                return QString::number(mIdentifier.toInt() - 1);
+            }
+            break;
+        case StringIdentifier:
+            return mPreviousIdentifier;
+    }
+    return QString();
+}
+
+QString ComicProviderJson::firstStripIdentifier() const
+{
+    if (identifierType() == StringIdentifier) {
+        return mManifest ? mManifest->firstIdentifier : QString();
+    }
+    return ComicProvider::firstStripIdentifier();
+}
+
+QString ComicProviderJson::stripTitle() const
+{
+    return mTitle;
+}
+
+QString ComicProviderJson::additionalText() const
+{
+    return mAdditionalText;
+}
+
+bool ComicProviderJson::isLeftToRight() const
+{
+    return mManifest ? mManifest->isLeftToRight : true;
+}
+
+bool ComicProviderJson::isTopToBottom() const
+{
+    return mManifest ? mManifest->isTopToBottom : true;
+}
@@ -0,0 +1,112 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef COMICPROVIDERJSON_H
+#define COMICPROVIDERJSON_H
+
+#include "comicprovider.h"
+
+#include <QByteArray>
+#include <QImage>
+#include <QSharedPointer>
+#include <QUrl>
+
+struct ComicManifest;
+
+/**
+ * This class provides comics described by a declarative manifest, the
+ * contents/code/main.json of the comic package, without a script interpreter.
+ *
+ * The manifest is a JSON object with the following keys, only "websiteUrl"
+ * and the "image" rule are mandatory:
+ *   websiteUrl       page of a strip, %{identifier} is replaced by the identifier
+ *   currentUrl       page of the most recent strip, defaults to websiteUrl
+ *                    with an empty identifier
+ *   shopUrl, author  static information about the comic
+ *   textCodec        codec of the pages, otherwise taken from the html
+ *   firstIdentifier  identifier of the first strip
+ *   dateFormat       how Date identifiers are written in urls, defaults to yyyy-MM-dd
+ *   weekdays         for Date identifiers the days of the week with a strip, 1 is Monday
+ *   leftToRight, topToBottom
+ *   rules            object of regular expressions run on the pages, the first
+ *                    capture is used: "identifier" (on the page of the most recent
+ *                    strip), "image", "title", "additionalText", "author" and for
+ *                    String identifiers "previous" and "next"
+ *
+ * Previous and next identifiers of Date and Number comics are calculated,
+ * the most recent strip of a Number comic is remembered from the last time
+ * its current strip was fetched.
+ * The manifests are parsed and their expressions compiled only once.
+ */
+class ComicProviderJson : public ComicProvider
+{
+        Q_OBJECT
+
+    public:
+        /**
+         * Expects the same arguments as every ComicProvider, followed by
+         * the path of the manifest.
+         */
+        ComicProviderJson(QObject *parent, const QVariantList &args);
+        ~ComicProviderJson() override;
+
+        IdentifierType identifierType() const override;
+        QUrl websiteUrl() const override;
+        QUrl shopUrl() const override;
+        QImage image() const override;
+        QByteArray imageData() const override;
+        QString identifier() const override;
+        QString nextIdentifier() const override;
+        QString previousIdentifier() const override;
+        QString firstStripIdentifier() const override;
+        QString stripTitle() const override;
+        QString additionalText() const override;
+        bool isLeftToRight() const override;
+        bool isTopToBottom() const override;
+
+    protected:
+        void pageRetrieved(int id, const QByteArray &data) override;
+        void pageError(int id, const QString &message) override;
+
+    private Q_SLOTS:
+        void start();
+
+    private:
+        enum {
+            CurrentPage = User
+        };
+
+        QString identifierToString(const QVariant &identifier) const;
+        QUrl pageUrl(const QVariant &identifier) const;
+        QString decode(const QByteArray &data) const;
+        QString capture(const QString &rule, const QString &page) const;
+        void processPage(const QString &page, const QUrl &url);
+        QDate stepDate(const QDate &date, int direction) const;
+
+        QSharedPointer<const ComicManifest> mManifest;
+        QVariant mIdentifier;
+        QVariant mLastIdentifier;
+        QString mPreviousIdentifier;
+        QString mNextIdentifier;
+        QString mTitle;
+        QString mAdditionalText;
+        QImage mImage;
+        QByteArray mImageData;
+};
+
+#endif
@@ -24,42 +24,60 @@
 KPackage::PackageStructure *ComicProviderKross::m_packageStructure(nullptr);
 
 ComicProviderKross::ComicProviderKross(QObject *parent, const QVariantList &args)
-    : ComicProvider(parent, args), m_wrapper(this)
-{
+    : ComicProvider(parent, args), m_wrapper(ComicProviderWrapper::acquire(this))
+{
+    //until the script finished, e.g. after an error, only the request is known
+    switch (identifierType()) {
+    case DateIdentifier:
+        m_result.identifier = requestedDate();
+        break;
+    case NumberIdentifier:
+        m_result.identifier = requestedNumber();
+        break;
+    case StringIdentifier:
+        m_result.identifier = requestedString();
+        break;
+    }
 }
 
 ComicProviderKross::~ComicProviderKross()
 {
+    m_wrapper->release();
 }
 
 bool ComicProviderKross::isLeftToRight() const
 {
-    return m_wrapper.isLeftToRight();
+    return m_result.isLeftToRight;
 }
 
 bool ComicProviderKross::isTopToBottom() const
 {
-    return m_wrapper.isTopToBottom();
+    return m_result.isTopToBottom;
 }
 
 ComicProvider::IdentifierType ComicProviderKross::identifierType() const
 {
-    return m_wrapper.identifierType();
+    return m_wrapper->identifierType();
 }
 
 QUrl ComicProviderKross::websiteUrl() const
 {
-    return QUrl(m_wrapper.websiteUrl());
+    return QUrl(m_result.websiteUrl);
 }
 
 QUrl ComicProviderKross::shopUrl() const
 {
-    return QUrl(m_wrapper.shopUrl());
+    return QUrl(m_result.shopUrl);
 }
 
 QImage ComicProviderKross::image() const
 {
-    return m_wrapper.comicImage();
+    return m_result.image;
+}
+
+QByteArray ComicProviderKross::imageData() const
+{
+    return m_result.imageData;
 }
 
 QString ComicProviderKross::identifierToString(const QVariant &identifier) const
@@ -78,47 +96,47 @@ QString ComicProviderKross::identifierToString(const QVariant &identifier) const
 
 QString ComicProviderKross::identifier() const
 {
-    return pluginName() + QLatin1Char(':') + identifierToString(m_wrapper.identifierVariant());
+    return pluginName() + QLatin1Char(':') + identifierToString(m_result.identifier);
 }
 
 QString ComicProviderKross::nextIdentifier() const
 {
-    return identifierToString(m_wrapper.nextIdentifierVariant());
+    return identifierToString(m_result.nextIdentifier);
 }
 
 QString ComicProviderKross::previousIdentifier() const
 {
-    return  identifierToString(m_wrapper.previousIdentifierVariant());
+    return  identifierToString(m_result.previousIdentifier);
 }
 
 QString ComicProviderKross::firstStripIdentifier() const
 {
-    return identifierToString(m_wrapper.firstIdentifierVariant());
+    return identifierToString(m_result.firstIdentifier);
 }
 
 QString ComicProviderKross::stripTitle() const
 {
-    return m_wrapper.title();
+    return m_result.title;
 }
 
 QString ComicProviderKross::additionalText() const
 {
-    return m_wrapper.additionalText();
+    return m_result.additionalText;
 }
 
 void ComicProviderKross::pageRetrieved(int id, const QByteArray &data)
 {
-    m_wrapper.pageRetrieved(id, data);
+    m_wrapper->pageRetrieved(id, data);
 }
 
 void ComicProviderKross::pageError(int id, const QString &message)
 {
-    m_wrapper.pageError(id, message);
+    m_wrapper->pageError(id, message);
 }
 
 void ComicProviderKross::redirected(int id, const QUrl &newUrl)
 {
-    m_wrapper.redirected(id, newUrl);
+    m_wrapper->redirected(id, newUrl);
 }
 
 KPackage::PackageStructure *ComicProviderKross::packageStructure()
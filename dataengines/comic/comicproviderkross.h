@@ -43,6 +43,7 @@ class ComicProviderKross : public ComicProvider
         QUrl websiteUrl() const override;
         QUrl shopUrl() const override;
         QImage image() const override;
+        QByteArray imageData() const override;
         QString identifier() const override;
         QString nextIdentifier() const override;
         QString previousIdentifier() const override;
@@ -57,7 +58,8 @@ class ComicProviderKross : public ComicProvider
         QString identifierToString(const QVariant &identifier) const;
 
     private:
-        mutable ComicProviderWrapper m_wrapper;
+        ComicProviderWrapper *m_wrapper;
+        ComicScriptResult m_result;
         static KPackage::PackageStructure *m_packageStructure;
 };
 
@@ -20,13 +20,21 @@
 #include "comicproviderwrapper.h"
 #include "comicproviderkross.h"
 #include "comicprovider.h"
+#include "comicstatistics.h"
 
 #include <QTimer>
 #include <QBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QPointer>
+#include <QThread>
 #include <QPainter>
 #include <QTextCodec>
 #include <QUrl>
 #include <QDebug>
+#include <QFileInfo>
+#include <QGlobalStatic>
 #include <QStandardPaths>
 #include <Plasma/Package>
 #include <Kross/Core/Action>
@@ -40,7 +48,8 @@ QStringList ComicProviderWrapper::mExtensions;
 ImageWrapper::ImageWrapper(QObject *parent, const QByteArray &data)
   : QObject(parent),
     mImage(QImage::fromData(data)),
-    mRawData(data)
+    mRawData(data),
+    mIsOriginal(!data.isEmpty())
 {
     resetImageReader();
 }
@@ -54,6 +63,7 @@ void ImageWrapper::setImage(const QImage &image)
 {
     mImage = image;
     mRawData.clear();
+    mIsOriginal = false;
 
     resetImageReader();
 }
@@ -72,10 +82,16 @@ void ImageWrapper::setRawData(const QByteArray &rawData)
 {
     mRawData = rawData;
     mImage = QImage::fromData(mRawData);
+    mIsOriginal = !mRawData.isEmpty();
 
     resetImageReader();
 }
 
+QByteArray ImageWrapper::originalData() const
+{
+    return mIsOriginal ? mRawData : QByteArray();
+}
+
 void ImageWrapper::resetImageReader()
 {
     if (mBuffer.isOpen()) {
@@ -274,18 +290,46 @@ QString StaticDateWrapper::shortMonthName (int month)
     return QLocale::system().monthName(month, QLocale::ShortFormat);
 }
 
-ComicProviderWrapper::ComicProviderWrapper(ComicProviderKross *parent)
-    : QObject(parent),
+static const int MAX_IDLE_WRAPPERS = 3;
+//interpreters creating an engine of their own for each script, only those run in the script threads
+static const QStringList THREADED_INTERPRETERS = QStringList() << QStringLiteral("qtscript");
+//how long shutting down waits for a script that is still running
+static const int SHUTDOWN_TIMEOUT = 3000;
+
+// idle wrappers by plugin name, each with its script loaded already
+typedef QHash<QString, QList<ComicProviderWrapper*> > WrapperPool;
+Q_GLOBAL_STATIC(WrapperPool, s_pool)
+
+// threads the scripts run in, if that has been enabled
+struct ScriptThreads
+{
+    QMutex mutex;
+    QList<QThread*> threads;
+    QList<QObject*> anchors; ///< one object living in each thread, to queue calls there
+    int count = 0;
+    int next = 0;
+    bool shuttingDown = false;
+};
+Q_GLOBAL_STATIC(ScriptThreads, s_threads)
+
+ComicProviderWrapper::ComicProviderWrapper(ComicProviderKross *provider)
+    : QObject(nullptr),
       mAction(nullptr),
-      mProvider(parent),
+      mProvider(provider),
+      mFuncFound(false),
       mKrossImage(nullptr),
+      mStaticDate(nullptr),
       mPackage(nullptr),
+      mPluginName(provider->pluginName()),
+      mGeneration(0),
+      mIdentifierType(ComicProvider::StringIdentifier),
+      mRequestedNumber(0),
+      mIsCurrent(false),
       mRequests(0),
       mIdentifierSpecified(false),
       mIsLeftToRight(true),
       mIsTopToBottom(true)
 {
-    QTimer::singleShot(0, this, SLOT(init()));
 }
 
 ComicProviderWrapper::~ComicProviderWrapper()
@@ -293,10 +337,260 @@ ComicProviderWrapper::~ComicProviderWrapper()
     delete mPackage;
 }
 
+ComicProviderWrapper *ComicProviderWrapper::acquire(ComicProviderKross *provider)
+{
+    ComicProviderWrapper *wrapper = nullptr;
+    {
+        QMutexLocker locker(&s_threads->mutex);
+        QList<ComicProviderWrapper*> &idle = (*s_pool)[provider->pluginName()];
+        while (!wrapper && !idle.isEmpty()) {
+            wrapper = idle.takeLast();
+            //the package has been updated or removed in the meantime
+            const QFileInfo info(wrapper->mScriptPath);
+            if (!info.exists() || info.lastModified() != wrapper->mScriptModified) {
+                wrapper->deleteInThread();
+                wrapper = nullptr;
+            }
+        }
+    }
+
+    if (wrapper) {
+        QMutexLocker locker(&s_threads->mutex);
+        wrapper->mProvider = provider;
+    } else {
+        wrapper = new ComicProviderWrapper(provider);
+        wrapper->extensions();
+        ComicProviderKross::packageStructure();
+        //the interpreter is created here, Kross::Manager does not guard that against other threads
+        const QString path = QStandardPaths::locate(QStandardPaths::GenericDataLocation, QLatin1String("plasma/comics/") + provider->pluginName() + QLatin1Char('/'), QStandardPaths::LocateDirectory);
+        KPackage::Package package(ComicProviderKross::packageStructure());
+        package.setPath(path);
+        const QString interpreter = Kross::Manager::self().interpreternameForFile(mainScript(package));
+        if (THREADED_INTERPRETERS.contains(interpreter) && Kross::Manager::self().interpreter(interpreter)) {
+            if (QThread *thread = scriptThread()) {
+                wrapper->moveToThread(thread);
+            }
+        }
+    }
+
+    //the script only sees copies of the request, the provider belongs to the main thread
+    const QString type = provider->suffixType();
+    if (type == QLatin1String("Date")) {
+        wrapper->mIdentifierType = ComicProvider::DateIdentifier;
+    } else if (type == QLatin1String("Number")) {
+        wrapper->mIdentifierType = ComicProvider::NumberIdentifier;
+    } else {
+        wrapper->mIdentifierType = ComicProvider::StringIdentifier;
+    }
+    wrapper->mRequestedDate = provider->requestedDate();
+    wrapper->mRequestedNumber = provider->requestedNumber();
+    wrapper->mRequestedString = provider->requestedString();
+
+    //like before the script is started once the event loop is reached, by then
+    //the provider is fully set up; the generation makes sure that a released
+    //wrapper does not start for its old provider
+    const int generation = ++wrapper->mGeneration;
+    QTimer::singleShot(0, provider, [wrapper, provider, generation]() {
+        wrapper->mIsCurrent = provider->isCurrent();
+        wrapper->mComicAuthor = provider->comicAuthor();
+        QMetaObject::invokeMethod(wrapper, [wrapper, generation]() {
+            if (wrapper->mGeneration == generation) {
+                wrapper->init();
+            }
+        }, Qt::AutoConnection);
+    });
+    return wrapper;
+}
+
+void ComicProviderWrapper::release()
+{
+    //the script might still be running in its thread, clean up there
+    if (thread() != QThread::currentThread()) {
+        {
+            QMutexLocker locker(&s_threads->mutex);
+            mProvider = nullptr;
+        }
+        QMetaObject::invokeMethod(this, [this]() { release(); }, Qt::QueuedConnection);
+        return;
+    }
+
+    QMutexLocker locker(&s_threads->mutex);
+    ++mGeneration;
+    mProvider = nullptr;
+
+    QList<ComicProviderWrapper*> &idle = (*s_pool)[mPluginName];
+    if (!mAction || s_threads->shuttingDown || idle.count() >= MAX_IDLE_WRAPPERS) {
+        deleteLater();
+        return;
+    }
+
+    reset();
+    idle.append(this);
+}
+
+void ComicProviderWrapper::clearPool(const QString &pluginName)
+{
+    QMutexLocker locker(&s_threads->mutex);
+    if (!pluginName.isEmpty()) {
+        const QList<ComicProviderWrapper*> idle = s_pool->take(pluginName);
+        for (ComicProviderWrapper *wrapper : idle) {
+            wrapper->deleteInThread();
+        }
+        return;
+    }
+
+    for (QList<ComicProviderWrapper*> &idle : *s_pool) {
+        for (ComicProviderWrapper *wrapper : qAsConst(idle)) {
+            wrapper->deleteInThread();
+        }
+    }
+    s_pool->clear();
+}
+
+void ComicProviderWrapper::deleteInThread()
+{
+    if (thread() == QThread::currentThread()) {
+        delete this;
+    } else {
+        deleteLater();
+    }
+}
+
+void ComicProviderWrapper::setScriptThreads(int count)
+{
+    //created here, in the main thread, the scripts only use them
+    Kross::Manager::self();
+
+    QMutexLocker locker(&s_threads->mutex);
+    s_threads->count = qMax(count, 0);
+}
+
+QThread *ComicProviderWrapper::scriptThread()
+{
+    QMutexLocker locker(&s_threads->mutex);
+    if (s_threads->count <= 0 || s_threads->shuttingDown) {
+        return nullptr;
+    }
+
+    if (s_threads->threads.count() < s_threads->count) {
+        QThread *thread = new QThread;
+        thread->setObjectName(QStringLiteral("ComicScripts"));
+        QObject *anchor = new QObject;
+        anchor->moveToThread(thread);
+        thread->start(QThread::LowPriority);
+        s_threads->threads << thread;
+        s_threads->anchors << anchor;
+        return thread;
+    }
+
+    s_threads->next = (s_threads->next + 1) % s_threads->count;
+    return s_threads->threads.value(s_threads->next);
+}
+
+void ComicProviderWrapper::shutdown()
+{
+    {
+        QMutexLocker locker(&s_threads->mutex);
+        s_threads->shuttingDown = true;
+    }
+    clearPool();
+
+    //pending releases are queued before the quit, wrappers left behind get deleted when the thread finishes
+    for (int i = 0; i < s_threads->threads.count(); ++i) {
+        QThread *thread = s_threads->threads[i];
+        QObject *anchor = s_threads->anchors[i];
+        QMetaObject::invokeMethod(anchor, [thread, anchor]() {
+            delete anchor;
+            thread->quit();
+        }, Qt::QueuedConnection);
+        if (!thread->wait(SHUTDOWN_TIMEOUT)) {
+            //do not block the shutdown of the process, the thread quits once its script returns
+            qWarning() << "A comic script did not finish within" << SHUTDOWN_TIMEOUT << "ms, leaving its thread behind.";
+            QObject::connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+            if (!thread->isFinished()) {
+                continue;
+            }
+        }
+        delete thread;
+    }
+    s_threads->threads.clear();
+    s_threads->anchors.clear();
+    s_threads->next = 0;
+    s_threads->shuttingDown = false;
+}
+
+void ComicProviderWrapper::callProvider(const std::function<void (ComicProviderKross*)> &function)
+{
+    QPointer<ComicProviderKross> provider;
+    {
+        QMutexLocker locker(&s_threads->mutex);
+        provider = mProvider;
+    }
+    if (thread() == QCoreApplication::instance()->thread()) {
+        if (provider) {
+            function(provider);
+        }
+        return;
+    }
+
+    //the provider and its network jobs live in the main thread
+    QMetaObject::invokeMethod(QCoreApplication::instance(), [provider, function]() {
+        if (provider) {
+            function(provider);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void ComicProviderWrapper::reset()
+{
+    //objects handed to the script during the request, the ones created
+    //when the script got loaded may still be referenced by it and stay
+    QObjectList objects = children();
+    if (mStaticDate) {
+        objects << mStaticDate->children();
+    }
+    for (QObject *object : qAsConst(objects)) {
+        if (!mScriptObjects.contains(object)) {
+            delete object;
+        }
+    }
+
+    mFuncFound = false;
+    mKrossImage = nullptr;
+    mComicAuthor.clear();
+    mTextCodec.clear();
+    mWebsiteUrl.clear();
+    mShopUrl.clear();
+    mTitle.clear();
+    mAdditionalText.clear();
+    mIdentifier.clear();
+    mNextIdentifier.clear();
+    mPreviousIdentifier.clear();
+    mFirstIdentifier.clear();
+    mLastIdentifier.clear();
+    mRequests = 0;
+    mIdentifierSpecified = false;
+    mIsLeftToRight = true;
+    mIsTopToBottom = true;
+}
+
 void ComicProviderWrapper::init()
 {
-    const QString path = QStandardPaths::locate(QStandardPaths::GenericDataLocation, QLatin1String("plasma/comics/") + mProvider->pluginName() + QLatin1Char('/'),QStandardPaths::LocateDirectory);
-    //qDebug() << "ComicProviderWrapper::init() package is" << mProvider->pluginName() << " at " <<  path;
+    if (!mAction) {
+        load();
+    }
+
+    if (mAction) {
+        mIdentifierSpecified = !mIsCurrent;
+        setIdentifierToDefault();
+        callFunction(QLatin1String("init"));
+    }
+}
+
+void ComicProviderWrapper::load()
+{
+    const QString path = QStandardPaths::locate(QStandardPaths::GenericDataLocation, QLatin1String("plasma/comics/") + mPluginName + QLatin1Char('/'),QStandardPaths::LocateDirectory);
+    //qDebug() << "ComicProviderWrapper::load() package is" << mPluginName << " at " <<  path;
 
     if (!path.isEmpty()) {
         mPackage = new KPackage::Package(ComicProviderKross::packageStructure());
@@ -309,31 +603,40 @@ void ComicProviderWrapper::init()
             // https://techbase.kde.org/Development/Tutorials/Plasma4/ComicPlugin#Package_Structure has main.es defined as mainscript.
             // Also Package::isValid() fails because the mainscript search fails to find the "main" file from mainscript.
 
-            QString mainscript = mPackage->filePath("scripts") + QLatin1String("/main");
-            QFileInfo info(mainscript);
-            for (int i = 0; i < extensions().count() && !info.exists(); ++i) {
-                    info.setFile(mainscript + extensions().value(i));
-                    //qDebug() << "ComicProviderWrapper::init() mainscript found as" << info.filePath();
-            }
-
+            QFileInfo info(mainScript(*mPackage));
             if (info.exists()) {
-                mAction = new Kross::Action(parent(), mProvider->pluginName());
+                mAction = new Kross::Action(this, mPluginName);
                 if (mAction) {
+                    mScriptPath = info.filePath();
+                    mScriptModified = info.lastModified();
+                    mStaticDate = new StaticDateWrapper(this);
                     mAction->addObject(this, QLatin1String("comic"));
-                    mAction->addObject(new StaticDateWrapper(this), QLatin1String("date"));
-                    mAction->setFile(info.filePath());
+                    mAction->addObject(mStaticDate, QLatin1String("date"));
+                    mAction->setFile(mScriptPath);
                     mAction->trigger();
                     mFunctions = mAction->functionNames();
 
-                    mIdentifierSpecified = !mProvider->isCurrent();
-                    setIdentifierToDefault();
-                    callFunction(QLatin1String("init"));
+                    const QObjectList objects = children() + mStaticDate->children();
+                    for (QObject *object : objects) {
+                        mScriptObjects.insert(object);
+                    }
                 }
             }
         }
     }
 }
 
+QString ComicProviderWrapper::mainScript(const KPackage::Package &package)
+{
+    const QString mainscript = package.filePath("scripts") + QLatin1String("/main");
+    QFileInfo info(mainscript);
+    for (int i = 0; i < mExtensions.count() && !info.exists(); ++i) {
+            info.setFile(mainscript + mExtensions.value(i));
+            //qDebug() << "ComicProviderWrapper::load() mainscript found as" << info.filePath();
+    }
+    return info.exists() ? info.filePath() : QString();
+}
+
 const QStringList& ComicProviderWrapper::extensions() const
 {
     if (mExtensions.isEmpty()) {
@@ -353,28 +656,16 @@ const QStringList& ComicProviderWrapper::extensions() const
 
 ComicProvider::IdentifierType ComicProviderWrapper::identifierType() const
 {
-    ComicProvider::IdentifierType result = ComicProvider::StringIdentifier;
-    const QString type = mProvider->description().value(QLatin1String("X-KDE-PlasmaComicProvider-SuffixType"));
-    if (type == QLatin1String("Date")) {
-        result = ComicProvider::DateIdentifier;
-    } else if (type == QLatin1String("Number")) {
-        result = ComicProvider::NumberIdentifier;
-    } else if (type == QLatin1String("String")) {
-        result = ComicProvider::StringIdentifier;
-    }
-    return result;
+    return mIdentifierType;
 }
 
-QImage ComicProviderWrapper::comicImage()
+ImageWrapper *ComicProviderWrapper::comicImageWrapper()
 {
     ImageWrapper* img = qobject_cast<ImageWrapper*>(callFunction(QLatin1String("image")).value<QObject*>());
     if (functionCalled() && img) {
-        return img->image();
-    }
-    if (mKrossImage) {
-        return mKrossImage->image();
+        return img;
     }
-    return QImage();
+    return mKrossImage;
 }
 
 QVariant ComicProviderWrapper::identifierToScript(const QVariant &identifier)
@@ -440,15 +731,15 @@ void ComicProviderWrapper::setIdentifierToDefault()
 {
     switch (identifierType()) {
     case DateIdentifier:
-        mIdentifier = mProvider->requestedDate();
+        mIdentifier = mRequestedDate;
         mLastIdentifier = QDate::currentDate();
         break;
     case NumberIdentifier:
-        mIdentifier = mProvider->requestedNumber();
+        mIdentifier = mRequestedNumber;
         mFirstIdentifier = 1;
         break;
     case StringIdentifier:
-        mIdentifier = mProvider->requestedString();
+        mIdentifier = mRequestedString;
         break;
     }
 }
@@ -490,12 +781,15 @@ void ComicProviderWrapper::setTextCodec(const QString &textCodec)
 
 QString ComicProviderWrapper::comicAuthor() const
 {
-    return mProvider->comicAuthor();
+    return mComicAuthor;
 }
 
 void ComicProviderWrapper::setComicAuthor(const QString &author)
 {
-    mProvider->setComicAuthor(author);
+    mComicAuthor = author;
+    callProvider([author](ComicProviderKross *provider) {
+        provider->setComicAuthor(author);
+    });
 }
 
 QString ComicProviderWrapper::websiteUrl() const
@@ -585,12 +879,20 @@ QVariant ComicProviderWrapper::firstIdentifier()
 void ComicProviderWrapper::setFirstIdentifier(const QVariant &firstIdentifier)
 {
     switch (identifierType()) {
-    case DateIdentifier:
-        mProvider->setFirstStripDate(DateWrapper::fromVariant(firstIdentifier));
+    case DateIdentifier: {
+        const QDate date = DateWrapper::fromVariant(firstIdentifier);
+        callProvider([date](ComicProviderKross *provider) {
+            provider->setFirstStripDate(date);
+        });
         break;
-    case NumberIdentifier:
-        mProvider->setFirstStripNumber(firstIdentifier.toInt());
+    }
+    case NumberIdentifier: {
+        const int number = firstIdentifier.toInt();
+        callProvider([number](ComicProviderKross *provider) {
+            provider->setFirstStripNumber(number);
+        });
         break;
+    }
     case StringIdentifier:
         break;
     }
@@ -714,6 +1016,11 @@ QVariant ComicProviderWrapper::previousIdentifierVariant() const
 
 void ComicProviderWrapper::pageRetrieved(int id, const QByteArray &data)
 {
+    if (thread() != QThread::currentThread()) {
+        QMetaObject::invokeMethod(this, [this, id, data]() { pageRetrieved(id, data); }, Qt::QueuedConnection);
+        return;
+    }
+
     --mRequests;
     if (id == Image) {
         mKrossImage = new ImageWrapper(this, data);
@@ -738,15 +1045,25 @@ void ComicProviderWrapper::pageRetrieved(int id, const QByteArray &data)
 
 void ComicProviderWrapper::pageError(int id, const QString &message)
 {
+    if (thread() != QThread::currentThread()) {
+        QMetaObject::invokeMethod(this, [this, id, message]() { pageError(id, message); }, Qt::QueuedConnection);
+        return;
+    }
+
     --mRequests;
     callFunction(QLatin1String("pageError"), QVariantList() << id << message);
     if (!functionCalled()) {
-        emit mProvider->error(mProvider);
+        error();
     }
 }
 
 void ComicProviderWrapper::redirected(int id, const QUrl &newUrl)
 {
+    if (thread() != QThread::currentThread()) {
+        QMetaObject::invokeMethod(this, [this, id, newUrl]() { redirected(id, newUrl); }, Qt::QueuedConnection);
+        return;
+    }
+
     --mRequests;
     callFunction(QLatin1String("redirected"), QVariantList() << id << newUrl);
     if (mRequests < 1) { //Don't finish while there are still requests
@@ -766,12 +1083,37 @@ void ComicProviderWrapper::finished() const
     qDebug() << QString::fromLatin1("Last Identifier").leftJustified(22, QLatin1Char('.')) << mLastIdentifier;
     qDebug() << QString::fromLatin1("Next Identifier").leftJustified(22, QLatin1Char('.')) << mNextIdentifier;
     qDebug() << QString::fromLatin1("Previous Identifier").leftJustified(22, QLatin1Char('.')) << mPreviousIdentifier;
-    emit mProvider->finished(mProvider);
+
+    //everything the engine asks for afterwards is copied here, in the thread of the script,
+    //the provider never calls into the script or reads the wrapper
+    ComicProviderWrapper *self = const_cast<ComicProviderWrapper*>(this);
+    ImageWrapper *img = self->comicImageWrapper();
+    ComicScriptResult result;
+    result.image = img ? img->image() : QImage();
+    result.imageData = img ? img->originalData() : QByteArray();
+    result.websiteUrl = mWebsiteUrl;
+    result.shopUrl = mShopUrl;
+    result.title = mTitle;
+    result.additionalText = mAdditionalText;
+    result.identifier = identifierVariant();
+    result.nextIdentifier = nextIdentifierVariant();
+    result.previousIdentifier = previousIdentifierVariant();
+    result.firstIdentifier = firstIdentifierVariant();
+    result.isLeftToRight = mIsLeftToRight;
+    result.isTopToBottom = mIsTopToBottom;
+
+    self->callProvider([result](ComicProviderKross *provider) {
+        provider->m_result = result;
+        emit provider->finished(provider);
+    });
 }
 
 void ComicProviderWrapper::error() const
 {
-    emit mProvider->error(mProvider);
+    //the provider keeps the result it was created with, which has no image
+    const_cast<ComicProviderWrapper*>(this)->callProvider([](ComicProviderKross *provider) {
+        emit provider->error(provider);
+    });
 }
 
 void ComicProviderWrapper::requestPage(const QString &url, int id, const QVariantMap &infos)
@@ -781,7 +1123,9 @@ void ComicProviderWrapper::requestPage(const QString &url, int id, const QVarian
     foreach (const QString& key, infos.keys()) {
         map[key] = infos[key].toString();
     }
-    mProvider->requestPage(QUrl(url), id, map);
+    callProvider([url, id, map](ComicProviderKross *provider) {
+        provider->requestPage(QUrl(url), id, map);
+    });
     ++mRequests;
 }
 
@@ -792,7 +1136,9 @@ void ComicProviderWrapper::requestRedirectedUrl(const QString &url, int id, cons
     foreach (const QString& key, infos.keys()) {
         map[key] = infos[key].toString();
     }
-    mProvider->requestRedirectedUrl(QUrl(url), id, map);
+    callProvider([url, id, map](ComicProviderKross *provider) {
+        provider->requestRedirectedUrl(QUrl(url), id, map);
+    });
     ++mRequests;
 }
 
@@ -807,7 +1153,11 @@ QVariant ComicProviderWrapper::callFunction(const QString &name, const QVariantL
     if (mAction) {
         mFuncFound = mFunctions.contains(name);
         if (mFuncFound) {
-            return mAction->callFunction(name, args);
+            QElapsedTimer timer;
+            timer.start();
+            const QVariant result = mAction->callFunction(name, args);
+            ComicStatistics::self()->addScriptCall(mPluginName, timer.elapsed());
+            return result;
         }
     }
     return QVariant();
@@ -26,6 +26,11 @@
 #include <QImage>
 #include <QImageReader>
 #include <QByteArray>
+#include <QDateTime>
+#include <QPointer>
+#include <QSet>
+
+#include <functional>
 
 namespace Kross {
     class Action;
@@ -34,6 +39,27 @@ namespace KPackage {
     class Package;
 }
 class ComicProviderKross;
+class QThread;
+
+/**
+ * What a script delivered, copied in the thread of the script once it
+ * finished, the provider only ever reads this copy
+ */
+struct ComicScriptResult
+{
+    QImage image;
+    QByteArray imageData;
+    QString websiteUrl;
+    QString shopUrl;
+    QString title;
+    QString additionalText;
+    QVariant identifier;
+    QVariant nextIdentifier;
+    QVariant previousIdentifier;
+    QVariant firstIdentifier;
+    bool isLeftToRight = true;
+    bool isTopToBottom = true;
+};
 
 class ImageWrapper : public QObject
 {
@@ -55,6 +81,12 @@ class ImageWrapper : public QObject
          */
         void setRawData(const QByteArray &rawData);
 
+        /**
+         * Returns the encoded data the image was created from, or an empty
+         * QByteArray if the image has been changed via setImage since
+         */
+        QByteArray originalData() const;
+
     public Q_SLOTS:
         /**
          * Returns the numbers of images contained in the image
@@ -78,6 +110,7 @@ class ImageWrapper : public QObject
     private:
         QImage mImage;
         mutable QByteArray mRawData;
+        bool mIsOriginal;
         QBuffer mBuffer;
         QImageReader mImageReader;
 };
@@ -197,13 +230,43 @@ class ComicProviderWrapper : public QObject
         };
         Q_ENUM(RedirectedUrlType)
 
-        explicit ComicProviderWrapper(ComicProviderKross *parent);
+        explicit ComicProviderWrapper(ComicProviderKross *provider);
         ~ComicProviderWrapper() override;
 
+        /**
+         * Returns a wrapper for @p provider, reusing an idle one of the same
+         * plugin if possible. That way the script gets loaded and its top level
+         * code run only once instead of for every strip.
+         * Call release() once the provider is done.
+         */
+        static ComicProviderWrapper *acquire(ComicProviderKross *provider);
+
+        /**
+         * Hands the wrapper back to the pool of its plugin
+         */
+        void release();
+
+        /**
+         * Deletes the idle wrappers of @p pluginName, e.g. once its package has
+         * been updated or removed, the idle wrappers of all plugins if it is empty
+         */
+        static void clearPool(const QString &pluginName = QString());
+
+        /**
+         * Runs the scripts of new wrappers in up to @p count threads,
+         * 0 runs them in the main thread. Only scripts of interpreters that
+         * can run in several threads at once are moved there.
+         */
+        static void setScriptThreads(int count);
+
+        /**
+         * Deletes all idle wrappers and stops the script threads
+         */
+        static void shutdown();
+
         int apiVersion() const { return 4600; }
 
         ComicProvider::IdentifierType identifierType() const;
-        QImage comicImage();
         void pageRetrieved(int id, const QByteArray &data);
         void pageError(int id, const QString &message);
         void redirected(int id, const QUrl &newUrl);
@@ -254,6 +317,7 @@ class ComicProviderWrapper : public QObject
         void init();
 
     protected:
+        ImageWrapper *comicImageWrapper();
         QVariant callFunction(const QString &name, const QVariantList &args = QVariantList());
         const QStringList& extensions() const;
         bool functionCalled() const;
@@ -261,15 +325,35 @@ class ComicProviderWrapper : public QObject
         QVariant identifierFromScript(const QVariant &identifier) const;
         void setIdentifierToDefault();
         void checkIdentifier(QVariant *identifier);
+        void load();
+        static QString mainScript(const KPackage::Package &package);
+        void reset();
+        void deleteInThread();
+        void callProvider(const std::function<void (ComicProviderKross*)> &function);
+        static QThread *scriptThread();
 
     private:
         Kross::Action *mAction;
-        ComicProviderKross *mProvider;
+        QPointer<ComicProviderKross> mProvider;
         QStringList mFunctions;
         bool mFuncFound;
         ImageWrapper *mKrossImage;
+        StaticDateWrapper *mStaticDate;
         static QStringList mExtensions;
         KPackage::Package *mPackage;
+        QString mPluginName;
+        QString mScriptPath;
+        QDateTime mScriptModified;
+        QSet<QObject*> mScriptObjects;
+        int mGeneration;
+
+        // copies of the request, the provider itself is only used in the main thread
+        ComicProvider::IdentifierType mIdentifierType;
+        QDate mRequestedDate;
+        int mRequestedNumber;
+        QString mRequestedString;
+        bool mIsCurrent;
+        QString mComicAuthor;
 
         QByteArray mTextCodec;
         QString mWebsiteUrl;
@@ -0,0 +1,158 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "comicstatistics.h"
+
+#include <QMutexLocker>
+
+// upper bounds of the histogram buckets in milliseconds, the last one is open
+static const qint64 HISTOGRAM_BOUNDS[] = { 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+static const int HISTOGRAM_SIZE = sizeof(HISTOGRAM_BOUNDS) / sizeof(HISTOGRAM_BOUNDS[0]) + 1;
+
+static QVariantList toVariantList(const QVector<qint64> &values)
+{
+    QVariantList list;
+    for (qint64 value : values) {
+        list << value;
+    }
+    return list;
+}
+
+ComicStatistics::Counters::Counters()
+    : requests(0),
+      cacheHits(0),
+      cacheMisses(0),
+      downloads(0),
+      bytes(0),
+      timeouts(0),
+      scriptCalls(0),
+      scriptTime(0),
+      latency(HISTOGRAM_SIZE, 0),
+      scriptDurations(HISTOGRAM_SIZE, 0)
+{
+}
+
+ComicStatistics *ComicStatistics::self()
+{
+    //scripts might count first, from their thread
+    static ComicStatistics statistics;
+    return &statistics;
+}
+
+ComicStatistics::ComicStatistics()
+{
+}
+
+void ComicStatistics::addToHistogram(QVector<qint64> &histogram, qint64 msecs)
+{
+    int bucket = 0;
+    while (bucket < HISTOGRAM_SIZE - 1 && msecs >= HISTOGRAM_BOUNDS[bucket]) {
+        ++bucket;
+    }
+    ++histogram[bucket];
+}
+
+void ComicStatistics::addRequest(const QString &comic, bool cached)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        Counters &counters = mCounters[comic];
+        ++counters.requests;
+        if (cached) {
+            ++counters.cacheHits;
+        } else {
+            ++counters.cacheMisses;
+        }
+    }
+    emit changed();
+}
+
+void ComicStatistics::addDownload(const QString &comic, qint64 bytes, qint64 msecs)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        Counters &counters = mCounters[comic];
+        ++counters.downloads;
+        counters.bytes += bytes;
+        addToHistogram(counters.latency, msecs);
+    }
+    emit changed();
+}
+
+void ComicStatistics::addScriptCall(const QString &comic, qint64 msecs)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        Counters &counters = mCounters[comic];
+        ++counters.scriptCalls;
+        counters.scriptTime += msecs;
+        addToHistogram(counters.scriptDurations, msecs);
+    }
+    emit changed();
+}
+
+void ComicStatistics::addTimeout(const QString &comic)
+{
+    {
+        QMutexLocker locker(&mMutex);
+        ++mCounters[comic].timeouts;
+    }
+    emit changed();
+}
+
+QStringList ComicStatistics::comics() const
+{
+    QMutexLocker locker(&mMutex);
+    return mCounters.keys();
+}
+
+QVariantMap ComicStatistics::statistics(const QString &comic) const
+{
+    QMutexLocker locker(&mMutex);
+    const Counters counters = mCounters.value(comic);
+
+    QVariantList bounds;
+    for (int i = 0; i < HISTOGRAM_SIZE - 1; ++i) {
+        bounds << HISTOGRAM_BOUNDS[i];
+    }
+
+    QVariantMap map;
+    map[QStringLiteral("Requests")] = counters.requests;
+    map[QStringLiteral("Cache hits")] = counters.cacheHits;
+    map[QStringLiteral("Cache misses")] = counters.cacheMisses;
+    map[QStringLiteral("Cache hit ratio")] = counters.requests ? double(counters.cacheHits) / counters.requests : 0.0;
+    map[QStringLiteral("Downloads")] = counters.downloads;
+    map[QStringLiteral("Network bytes")] = counters.bytes;
+    map[QStringLiteral("Timeouts")] = counters.timeouts;
+    map[QStringLiteral("Script calls")] = counters.scriptCalls;
+    map[QStringLiteral("Script time")] = counters.scriptTime;
+    map[QStringLiteral("Histogram bounds")] = bounds;
+    map[QStringLiteral("Fetch latency")] = toVariantList(counters.latency);
+    map[QStringLiteral("Script durations")] = toVariantList(counters.scriptDurations);
+    return map;
+}
+
+QJsonObject ComicStatistics::toJson() const
+{
+    QJsonObject json;
+    const QStringList names = comics();
+    for (const QString &comic : names) {
+        json[comic] = QJsonObject::fromVariantMap(statistics(comic));
+    }
+    return json;
+}
@@ -0,0 +1,100 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef COMICSTATISTICS_H
+#define COMICSTATISTICS_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QObject>
+#include <QVariantMap>
+#include <QVector>
+
+#include "plasma_comic_export.h"
+
+/**
+ * This class counts what the comics of a process spend their time on.
+ *
+ * The counters are kept per comic: requests, whether they were answered from
+ * the strip cache, downloaded bytes, timeouts and histograms of the download
+ * latency and of the time spent in the scripts. All methods are thread safe,
+ * scripts might run in worker threads.
+ */
+class PLASMA_COMIC_EXPORT ComicStatistics : public QObject
+{
+        Q_OBJECT
+
+    public:
+        /**
+         * Returns the statistics of this process.
+         */
+        static ComicStatistics *self();
+
+        void addRequest(const QString &comic, bool cached);
+        void addDownload(const QString &comic, qint64 bytes, qint64 msecs);
+        void addScriptCall(const QString &comic, qint64 msecs);
+        void addTimeout(const QString &comic);
+
+        /**
+         * Returns the comics with statistics.
+         */
+        QStringList comics() const;
+
+        /**
+         * Returns the statistics of @p comic, the histograms are lists of the
+         * counts below each of the "Histogram bounds" in milliseconds.
+         */
+        QVariantMap statistics(const QString &comic) const;
+
+        /**
+         * Returns the statistics of all comics.
+         */
+        QJsonObject toJson() const;
+
+    Q_SIGNALS:
+        /**
+         * Emitted once the statistics changed, possibly from another thread.
+         */
+        void changed();
+
+    private:
+        struct Counters {
+            Counters();
+
+            qint64 requests;
+            qint64 cacheHits;
+            qint64 cacheMisses;
+            qint64 downloads;
+            qint64 bytes;
+            qint64 timeouts;
+            qint64 scriptCalls;
+            qint64 scriptTime;
+            QVector<qint64> latency;
+            QVector<qint64> scriptDurations;
+        };
+
+        ComicStatistics();
+
+        static void addToHistogram(QVector<qint64> &histogram, qint64 msecs);
+
+        mutable QMutex mMutex;
+        QHash<QString, Counters> mCounters;
+};
+
+#endif
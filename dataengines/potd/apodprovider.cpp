@@ -39,7 +39,7 @@ ApodProvider::~ApodProvider() = default;
 
 QImage ApodProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void ApodProvider::pageRequestFinished(KJob *_job)
@@ -73,7 +73,7 @@ void ApodProvider::imageRequestFinished(KJob *_job)
 	return;
     }
 
-    mImage = QImage::fromData( job->data() );
+    setImageData( job->data() );
     emit finished(this);
 }
 
@@ -65,9 +65,6 @@ class ApodProvider : public PotdProvider
     private:
         void pageRequestFinished(KJob *job);
         void imageRequestFinished(KJob *job);
-
-    private:
-        QImage mImage;
 };
 
 #endif
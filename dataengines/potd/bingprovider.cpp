@@ -39,7 +39,7 @@ BingProvider::~BingProvider() = default;
 
 QImage BingProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void BingProvider::pageRequestFinished(KJob* _job)
@@ -85,7 +85,7 @@ void BingProvider::imageRequestFinished(KJob* _job)
         return;
     }
     QByteArray data = job->data();
-    mImage = QImage::fromData(data);
+    setImageData(data);
     emit finished(this);
 }
 
@@ -59,9 +59,6 @@ class BingProvider : public PotdProvider
     private:
         void pageRequestFinished(KJob *job);
         void imageRequestFinished(KJob *job);
-
-    private:
-        QImage mImage;
 };
 
 #endif
@@ -18,58 +18,52 @@
  */
 
 #include "cachedprovider.h"
+#include "potdcache.h"
 
-#include <QFile>
-#include <QFileInfo>
+#include <QBuffer>
+#include <QImageReader>
 #include <QTimer>
-#include <QThreadPool>
-#include <QStandardPaths>
-#include <QDir>
 #include <QDateTime>
 #include <QRegularExpression>
 
 #include <QDebug>
 
-LoadImageThread::LoadImageThread(const QString &filePath)
-    : m_filePath(filePath)
-{
-}
-
-void LoadImageThread::run()
-{
-    QImage image;
-    image.load(m_filePath );
-    emit done(image);
-}
-
-SaveImageThread::SaveImageThread(const QString &identifier, const QImage &image)
+SaveImageThread::SaveImageThread(const QString &identifier, const QImage &image, const QByteArray &data)
     : m_image(image),
+      m_data(data),
       m_identifier(identifier)
 {
 }
 
 void SaveImageThread::run()
 {
-    const QString path = CachedProvider::identifierToPath( m_identifier );
-    m_image.save(path, "JPEG");
-    emit done( m_identifier, path, m_image );
-}
+    // store the picture as downloaded, encode it only for providers not giving its data
+    if ( m_data.isEmpty() ) {
+        QBuffer buffer( &m_data );
+        buffer.open( QIODevice::WriteOnly );
+        m_image.save( &buffer, "JPEG" );
+    }
 
-QString CachedProvider::identifierToPath( const QString &identifier )
-{
-    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::TempLocation) + QLatin1String("/plasma_engine_potd/");
-    QDir d;
-    d.mkpath(dataDir);
-    return dataDir + identifier;
+    // the consumers decode the picture, only check that it is one
+    QBuffer buffer( &m_data );
+    buffer.open( QIODevice::ReadOnly );
+    QImageReader reader( &buffer );
+    if ( !reader.canRead() ) {
+        qWarning() << "could not read the picture" << m_identifier << reader.errorString();
+        emit done( m_identifier, false );
+        return;
+    }
+
+    emit done( m_identifier, PotdCache::self()->insert( m_identifier, m_data, reader.size() ) );
 }
 
 
 CachedProvider::CachedProvider( const QString &identifier, QObject *parent )
     : PotdProvider( parent ), mIdentifier( identifier )
 {
-    LoadImageThread *thread = new LoadImageThread( identifierToPath( mIdentifier ) );
-    connect(thread, SIGNAL(done(QImage)), this, SLOT(triggerFinished(QImage)));
-    QThreadPool::globalInstance()->start(thread);
+    // everything needed is in the index of the cache
+    PotdCache::self()->touch( mIdentifier );
+    QTimer::singleShot( 0, this, SLOT(triggerFinished()) );
 }
 
 CachedProvider::~CachedProvider()
@@ -78,7 +72,7 @@ CachedProvider::~CachedProvider()
 
 QImage CachedProvider::image() const
 {
-    return mImage;
+    return QImage( PotdCache::self()->path( mIdentifier ) );
 }
 
 QString CachedProvider::identifier() const
@@ -86,30 +80,26 @@ QString CachedProvider::identifier() const
     return mIdentifier;
 }
 
-void CachedProvider::triggerFinished(const QImage &image)
+void CachedProvider::triggerFinished()
 {
-    mImage = image;
     emit finished( this );
 }
 
 bool CachedProvider::isCached( const QString &identifier, bool ignoreAge )
 {
-    const QString path = identifierToPath( identifier );
-    if (!QFile::exists( path ) ) {
+    PotdCache *cache = PotdCache::self();
+    if ( !cache->contains( identifier ) ) {
         return false;
     }
 
     QRegularExpression re(QLatin1String(":\\d{4}-\\d{2}-\\d{2}"));
 
     if (!ignoreAge && !re.match(identifier).hasMatch()) {
-        // no date in the identifier, so it's a daily; check to see ifthe modification time is today
-        QFileInfo info( path );
-        if ( info.lastModified().daysTo( QDateTime::currentDateTime() ) >= 1 ) {
+        // no date in the identifier, so it's a daily; check to see if it was downloaded today
+        if ( cache->storedTime( identifier ).daysTo( QDateTime::currentDateTime() ) >= 1 ) {
             return false;
         }
     }
 
     return true;
 }
-
-
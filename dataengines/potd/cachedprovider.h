@@ -47,7 +47,7 @@ class CachedProvider : public PotdProvider
         ~CachedProvider() override;
 
         /**
-         * Returns the requested image.
+         * Returns the requested image, decoded from the cached file.
          *
          * Note: This method returns only a valid image after the
          *       finished() signal has been emitted.
@@ -64,32 +64,11 @@ class CachedProvider : public PotdProvider
          */
         static bool isCached( const QString &identifier, bool ignoreAge = false );
 
-        /**
-         * Returns a path for the given identifier
-         */
-        static QString identifierToPath( const QString &identifier );
-
     private Q_SLOTS:
-        void triggerFinished(const QImage &image);
+        void triggerFinished();
 
     private:
         QString mIdentifier;
-        QImage mImage;
-};
-
-class LoadImageThread : public QObject, public QRunnable
-{
-    Q_OBJECT
-
-public:
-    explicit LoadImageThread(const QString &filePath);
-    void run() override;
-
-Q_SIGNALS:
-    void done(const QImage &pixmap);
-
-private:
-    QString m_filePath;
 };
 
 class SaveImageThread : public QObject, public QRunnable
@@ -97,14 +76,18 @@ class SaveImageThread : public QObject, public QRunnable
     Q_OBJECT
 
 public:
-    SaveImageThread(const QString &identifier, const QImage &image);
+    SaveImageThread(const QString &identifier, const QImage &image, const QByteArray &data);
     void run() override;
 
 Q_SIGNALS:
-    void done( const QString &source, const QString &path, const QImage &img );
+    /**
+     * Emitted once the picture is stored, or not as it is no picture.
+     */
+    void done( const QString &source, bool stored );
 
 private:
     QImage m_image;
+    QByteArray m_data;
     QString m_identifier;
 };
 
@@ -39,7 +39,7 @@ EpodProvider::~EpodProvider() = default;
 
 QImage EpodProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void EpodProvider::pageRequestFinished(KJob *_job)
@@ -71,8 +71,7 @@ void EpodProvider::imageRequestFinished(KJob *_job)
 	return;
     }
 
-    // FIXME: this really should be done in a thread as this can block
-    mImage = QImage::fromData( job->data() );
+    setImageData( job->data() );
     emit finished(this);
 }
 
@@ -61,9 +61,6 @@ class EpodProvider : public PotdProvider
     private:
         void pageRequestFinished(KJob *job);
         void imageRequestFinished(KJob *job);
-
-    private:
-        QImage mImage;
 };
 
 #endif
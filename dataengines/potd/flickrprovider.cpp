@@ -59,7 +59,7 @@ FlickrProvider::~FlickrProvider() = default;
 
 QImage FlickrProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void FlickrProvider::pageRequestFinished(KJob *_job)
@@ -156,7 +156,7 @@ void FlickrProvider::imageRequestFinished(KJob *_job)
         return;
     }
 
-    mImage = QImage::fromData( job->data() );
+    setImageData( job->data() );
     emit finished(this);
 }
 
@@ -68,7 +68,6 @@ class FlickrProvider : public PotdProvider
 
     private:
         QDate mActualDate;
-        QImage mImage;
 
         QXmlStreamReader xml;
 
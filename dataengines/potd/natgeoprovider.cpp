@@ -40,7 +40,7 @@ NatGeoProvider::~NatGeoProvider() = default;
 
 QImage NatGeoProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void NatGeoProvider::pageRequestFinished(KJob* _job)
@@ -82,7 +82,7 @@ void NatGeoProvider::imageRequestFinished(KJob *_job)
         return;
     }
 
-    mImage = QImage::fromData( job->data() );
+    setImageData( job->data() );
     emit finished(this);
 }
 
@@ -69,8 +69,6 @@ class NatGeoProvider : public PotdProvider
         void imageRequestFinished(KJob *job);
 
     private:
-        QImage mImage;
-
         QRegularExpression re;
 };
 
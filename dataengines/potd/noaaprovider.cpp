@@ -39,7 +39,7 @@ NOAAProvider::~NOAAProvider() = default;
 
 QImage NOAAProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void NOAAProvider::pageRequestFinished(KJob* _job)
@@ -80,7 +80,7 @@ void NOAAProvider::imageRequestFinished(KJob *_job)
 	return;
     }
 
-    mImage = QImage::fromData( job->data() );
+    setImageData( job->data() );
     emit finished(this);
 }
 
@@ -62,9 +62,6 @@ class NOAAProvider : public PotdProvider
     private:
         void pageRequestFinished(KJob *job);
         void imageRequestFinished(KJob *job);
-
-   private:
-        QImage mImage;
 };
 
 #endif
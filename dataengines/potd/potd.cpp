@@ -19,24 +19,63 @@
 
 #include "potd.h"
 
+#include <QCoreApplication>
 #include <QDate>
-#include <QFile>
-#include <QFileInfo>
+#include <QDateTime>
+#include <QDBusConnection>
 #include <QRegularExpression>
 #include <QTimer>
 #include <QThreadPool>
+#include <QUrl>
 #include <QDebug>
 
+#include <KDirWatch>
+#include <KPluginFactory>
 #include <KPluginLoader>
 #include <KPluginMetaData>
 #include <Plasma/DataContainer>
 
 #include "cachedprovider.h"
+#include "potdcache.h"
 
 namespace {
 namespace DataKeys {
-inline QString image() { return QStringLiteral("Image"); }
-inline QString url()   { return QStringLiteral("Url"); }
+inline QString url()      { return QStringLiteral("Url"); }
+inline QString localUrl() { return QStringLiteral("LocalUrl"); }
+inline QString size()     { return QStringLiteral("Size"); }
+inline QString modified() { return QStringLiteral("Modified"); }
+}
+
+// retry interval of the pictures of the day that could not be updated yet
+const int RETRY_INTERVAL = 10 * 60 * 1000;
+
+// Returns when the picture of the day shown at now became the current one:
+// the last local midnight, or the last publish time (UTC) if that was later.
+QDateTime lastRollover( const QDateTime &now, const QTime &publishTime )
+{
+    QDateTime rollover( now.date(), QTime( 0, 0 ) );
+    if ( publishTime.isValid() ) {
+        QDateTime published( now.toUTC().date(), publishTime, Qt::UTC );
+        if ( published > now ) {
+            published = published.addDays( -1 );
+        }
+        rollover = qMax( rollover, published.toLocalTime() );
+    }
+    return rollover;
+}
+
+// Returns when the next picture of the day is due after now.
+QDateTime nextRollover( const QDateTime &now, const QTime &publishTime )
+{
+    QDateTime rollover( now.date().addDays( 1 ), QTime( 0, 0 ) );
+    if ( publishTime.isValid() ) {
+        QDateTime published( now.toUTC().date(), publishTime, Qt::UTC );
+        if ( published <= now ) {
+            published = published.addDays( 1 );
+        }
+        rollover = qMin( rollover, published.toLocalTime() );
+    }
+    return rollover;
 }
 }
 
@@ -45,30 +84,100 @@ PotdEngine::PotdEngine( QObject* parent, const QVariantList& args )
 {
     // set polling to every 5 minutes
     setMinimumPollingInterval(5 * 60 * 1000);
-    m_checkDatesTimer = new QTimer( this );//change picture after 24 hours
+
+    // change the pictures without a date once the day changed, the timer is
+    // only running while there are such pictures
+    m_checkDatesTimer = new QTimer( this );
+    m_checkDatesTimer->setSingleShot( true );
+    m_checkDatesTimer->setTimerType( Qt::PreciseTimer );
     connect( m_checkDatesTimer, SIGNAL(timeout()), this, SLOT(checkDayChanged()) );
-    //FIXME: would be nice to stop and start this timer ONLY as needed, e.g. only when there are
-    // time insensitive sources to serve; still, this is better than how i found it, checking
-    // every 2 seconds (!)
-    m_checkDatesTimer->setInterval( 10 * 60 * 1000 ); // check every 10 minutes
-    m_checkDatesTimer->start();
+    connect( this, SIGNAL(sourceAdded(QString)), this, SLOT(scheduleDayChange()) );
+    connect( this, SIGNAL(sourceRemoved(QString)), this, SLOT(scheduleDayChange()) );
+
+    // the timer does not run during suspend and does not follow changes of
+    // the clock or the time zone, check again then
+    QDBusConnection::systemBus().connect( QStringLiteral( "org.freedesktop.login1" ),
+                                          QStringLiteral( "/org/freedesktop/login1" ),
+                                          QStringLiteral( "org.freedesktop.login1.Manager" ),
+                                          QStringLiteral( "PrepareForSleep" ),
+                                          this, SLOT(prepareForSleep(bool)) );
+    QDBusConnection::systemBus().connect( QStringLiteral( "org.freedesktop.timedate1" ),
+                                          QStringLiteral( "/org/freedesktop/timedate1" ),
+                                          QStringLiteral( "org.freedesktop.DBus.Properties" ),
+                                          QStringLiteral( "PropertiesChanged" ),
+                                          this, SLOT(checkDayChanged()) );
+    QDBusConnection::sessionBus().connect( QString(), QString(),
+                                           QStringLiteral( "org.kde.kcmshell_clock" ),
+                                           QStringLiteral( "clockUpdated" ),
+                                           this, SLOT(checkDayChanged()) );
+
+    m_canDiscardCache = false;
+
+    // the plugins are looked up once the first source is requested
+    mPluginWatch = nullptr;
+}
+
+PotdEngine::~PotdEngine()
+{
+}
+
+void PotdEngine::loadProviders()
+{
+    if ( !mPluginWatch ) {
+        mPluginWatch = new KDirWatch( this );
+        const QStringList libraryPaths = QCoreApplication::libraryPaths();
+        for ( const QString &path : libraryPaths ) {
+            mPluginWatch->addDir( path + QLatin1String( "/potd" ) );
+        }
+        connect( mPluginWatch, SIGNAL(dirty(QString)), this, SLOT(loadProviders()) );
+        connect( mPluginWatch, SIGNAL(created(QString)), this, SLOT(loadProviders()) );
+        connect( mPluginWatch, SIGNAL(deleted(QString)), this, SLOT(loadProviders()) );
+    }
 
     const QVector<KPluginMetaData> plugins = KPluginLoader::findPlugins(QStringLiteral("potd"), [](const KPluginMetaData & md) {
         return md.serviceTypes().contains(QStringLiteral("PlasmaPoTD/Plugin"));
     });
 
+    QHash<QString, Provider> providers;
     for (const auto &metadata : plugins) {
-        QString provider = metadata.value(QLatin1String( "X-KDE-PlasmaPoTDProvider-Identifier" ));
-        if (provider.isEmpty()) {
+        QString name = metadata.value(QLatin1String( "X-KDE-PlasmaPoTDProvider-Identifier" ));
+        if (name.isEmpty()) {
             continue;
         }
-        mFactories.insert(provider, metadata);
-        setData( QLatin1String( "Providers" ), provider, metadata.name() );
+
+        // a loaded library is not unloaded anyway, so its factory is kept
+        // as long as the plugin stays installed at the same place
+        Provider provider = mProviders.value( name );
+        if ( provider.metadata.fileName() != metadata.fileName() ) {
+            provider.factory.clear();
+        }
+        provider.metadata = metadata;
+        providers.insert( name, provider );
     }
+    mProviders = providers;
+
+    removeAllData( QLatin1String( "Providers" ) );
+    updateProvidersSource();
 }
 
-PotdEngine::~PotdEngine()
+void PotdEngine::updateProvidersSource()
 {
+    for ( auto it = mProviders.constBegin(); it != mProviders.constEnd(); ++it ) {
+        setData( QLatin1String( "Providers" ), it.key(), it->metadata.name() );
+    }
+}
+
+KPluginFactory *PotdEngine::factory( const QString &providerName )
+{
+    auto it = mProviders.find( providerName );
+    if ( it == mProviders.end() ) {
+        return nullptr;
+    }
+
+    if ( !it->factory ) {
+        it->factory = KPluginLoader( it->metadata.fileName() ).factory();
+    }
+    return it->factory;
 }
 
 bool PotdEngine::updateSourceEvent( const QString &identifier )
@@ -83,9 +192,7 @@ bool PotdEngine::updateSource( const QString &identifier, bool loadCachedAlways
         QVariantList args;
         args << QLatin1String( "String" ) << identifier;
 
-        CachedProvider *provider = new CachedProvider( identifier, this );
-        connect( provider, SIGNAL(finished(PotdProvider*)), this, SLOT(finished(PotdProvider*)) );
-        connect( provider, SIGNAL(error(PotdProvider*)), this, SLOT(error(PotdProvider*)) );
+        loadCached( identifier );
 
         m_canDiscardCache = loadCachedAlways;
         if (!loadCachedAlways) {
@@ -93,6 +200,18 @@ bool PotdEngine::updateSource( const QString &identifier, bool loadCachedAlways
         }
     }
 
+    return downloadSource( identifier );
+}
+
+void PotdEngine::loadCached( const QString &identifier )
+{
+    CachedProvider *provider = new CachedProvider( identifier, this );
+    connect( provider, SIGNAL(finished(PotdProvider*)), this, SLOT(finished(PotdProvider*)) );
+    connect( provider, SIGNAL(error(PotdProvider*)), this, SLOT(error(PotdProvider*)) );
+}
+
+bool PotdEngine::downloadSource( const QString &identifier )
+{
 #if QT_VERSION < QT_VERSION_CHECK(5, 15, 0)
     const QStringList parts = identifier.split( QLatin1Char( ':' ), QString::SkipEmptyParts );
 #else
@@ -103,7 +222,7 @@ bool PotdEngine::updateSource( const QString &identifier, bool loadCachedAlways
         return false;
     }
     const QString providerName = parts[ 0 ];
-    if ( !mFactories.contains( providerName ) ) {
+    if ( !mProviders.contains( providerName ) ) {
         qDebug() << "invalid provider: " << parts[ 0 ];
         return false;
     }
@@ -114,7 +233,7 @@ bool PotdEngine::updateSource( const QString &identifier, bool loadCachedAlways
         args << parts[i];
     }
 
-    auto factory = KPluginLoader(mFactories[ providerName ].fileName()).factory();
+    KPluginFactory *factory = this->factory( providerName );
     PotdProvider *provider = nullptr;
     if (factory) {
         provider = factory->create<PotdProvider>(this, args);
@@ -130,8 +249,17 @@ bool PotdEngine::updateSource( const QString &identifier, bool loadCachedAlways
 
 bool PotdEngine::sourceRequestEvent( const QString &identifier )
 {
+    if ( !mPluginWatch ) {
+        loadProviders();
+    }
+    if ( identifier == QLatin1String( "Providers" ) ) {
+        updateProvidersSource();
+        return true;
+    }
+
     if ( updateSource( identifier, true ) ) {
-        setData(identifier, DataKeys::image(), QImage());
+        setData(identifier, DataKeys::url(), QString());
+        setData(identifier, DataKeys::localUrl(), QUrl());
         return true;
     }
 
@@ -140,32 +268,43 @@ bool PotdEngine::sourceRequestEvent( const QString &identifier )
 
 void PotdEngine::finished( PotdProvider *provider )
 {
-    if ( m_canDiscardCache && qobject_cast<CachedProvider *>( provider ) ) {
+    if ( qobject_cast<CachedProvider *>( provider ) ) {
         Plasma::DataContainer *source = containerForSource( provider->identifier() );
-        if ( source && !source->data().value(DataKeys::image()).value<QImage>().isNull() ) {
-            provider->deleteLater();
-            return;
+        if ( !m_canDiscardCache || !source || source->data().value(DataKeys::url()).toString().isEmpty() ) {
+            setCachedData( provider->identifier() );
         }
-    }
-
-    QImage img(provider->image());
-    // store in cache if it's not the response of a CachedProvider
-    if ( qobject_cast<CachedProvider*>( provider ) == nullptr && !img.isNull() ) {
-        SaveImageThread *thread = new SaveImageThread( provider->identifier(), img );
-        connect(thread, SIGNAL(done(QString,QString,QImage)), this, SLOT(cachingFinished(QString,QString,QImage)));
-        QThreadPool::globalInstance()->start(thread);
     } else {
-        setData(provider->identifier(), DataKeys::image(), img);
-        setData(provider->identifier(), DataKeys::url(), CachedProvider::identifierToPath( provider->identifier()));
+        // store in cache if it's not the response of a CachedProvider
+        const QByteArray data = provider->imageData();
+        const QImage img = data.isEmpty() ? provider->image() : QImage();
+        if ( !data.isEmpty() || !img.isNull() ) {
+            SaveImageThread *thread = new SaveImageThread( provider->identifier(), img, data );
+            connect(thread, SIGNAL(done(QString,bool)), this, SLOT(cachingFinished(QString,bool)));
+            QThreadPool::globalInstance()->start(thread);
+        }
     }
 
     provider->deleteLater();
 }
 
-void PotdEngine::cachingFinished( const QString &source, const QString &path, const QImage &img )
+void PotdEngine::cachingFinished( const QString &source, bool stored )
 {
-    setData(source, DataKeys::image(), img);
-    setData(source, DataKeys::url(), path);
+    if ( stored ) {
+        setCachedData( source );
+    }
+    scheduleDayChange();
+}
+
+void PotdEngine::setCachedData( const QString &identifier )
+{
+    // consumers decode the file themselves, at the size they show it
+    const PotdCache *cache = PotdCache::self();
+    Plasma::DataEngine::Data data;
+    data.insert( DataKeys::url(), cache->path( identifier ) );
+    data.insert( DataKeys::localUrl(), QUrl::fromLocalFile( cache->path( identifier ) ) );
+    data.insert( DataKeys::size(), cache->imageSize( identifier ) );
+    data.insert( DataKeys::modified(), cache->storedTime( identifier ) );
+    setData( identifier, data );
 }
 
 void PotdEngine::error( PotdProvider *provider )
@@ -174,33 +313,73 @@ void PotdEngine::error( PotdProvider *provider )
     provider->deleteLater();
 }
 
+bool PotdEngine::isUndated( const QString &identifier )
+{
+    // Check if the identifier contains ISO date string, like 2019-01-09.
+    // If so, the picture does not change.
+    static const QRegularExpression re(QLatin1String(":\\d{4}-\\d{2}-\\d{2}"));
+    return identifier != QLatin1String("Providers") && !re.match(identifier).hasMatch();
+}
+
+QTime PotdEngine::publishTime( const QString &identifier ) const
+{
+    const QString provider = identifier.section( QLatin1Char( ':' ), 0, 0 );
+    const QString time = mProviders.value( provider ).metadata.value( QStringLiteral( "X-KDE-PlasmaPoTDProvider-PublishTime" ) );
+    return QTime::fromString( time, QStringLiteral( "HH:mm" ) );
+}
+
+bool PotdEngine::isOutdated( const QString &identifier, const QDateTime &now ) const
+{
+    const PotdCache *cache = PotdCache::self();
+    return !cache->contains( identifier ) || cache->storedTime( identifier ) < lastRollover( now, publishTime( identifier ) );
+}
+
 void PotdEngine::checkDayChanged()
 {
-    SourceDict dict = containerDict();
-    QHashIterator<QString, Plasma::DataContainer*> it( dict );
-    QRegularExpression re(QLatin1String(":\\d{4}-\\d{2}-\\d{2}"));
+    const QDateTime now = QDateTime::currentDateTime();
+    const QStringList identifiers = sources();
+    for ( const QString &identifier : identifiers ) {
+        if ( isUndated( identifier ) && isOutdated( identifier, now ) ) {
+            downloadSource( identifier );
+        }
+    }
 
-    while ( it.hasNext() ) {
-        it.next();
+    scheduleDayChange();
+}
 
-        if (it.key() == QLatin1String("Providers")) {
+void PotdEngine::scheduleDayChange()
+{
+    const QDateTime now = QDateTime::currentDateTime();
+    const QStringList identifiers = sources();
+    qint64 interval = -1;
+    for ( const QString &identifier : identifiers ) {
+        if ( !isUndated( identifier ) ) {
             continue;
         }
 
-        // Check if the identifier contains ISO date string, like 2019-01-09.
-        // If so, don't update the picture. Otherwise, update the picture.
-        if ( !re.match(it.key()).hasMatch() ) {
-            const QString path = CachedProvider::identifierToPath( it.key() );
-            if ( !QFile::exists(path) ) {
-                updateSourceEvent( it.key() );
-            } else {
-                QFileInfo info( path );
-                if ( info.lastModified().daysTo( QDateTime::currentDateTime() ) >= 1 ) {
-                    updateSourceEvent( it.key() );
-                }
-            }
+        qint64 msecs = now.msecsTo( nextRollover( now, publishTime( identifier ) ) );
+        if ( isOutdated( identifier, now ) ) {
+            msecs = qMin( msecs, qint64( RETRY_INTERVAL ) );
+        }
+        if ( interval < 0 || msecs < interval ) {
+            interval = msecs;
         }
     }
+
+    if ( interval < 0 ) {
+        m_checkDatesTimer->stop();
+        return;
+    }
+
+    // wake up just after the day changed, not just before it
+    m_checkDatesTimer->start( int( qMax( interval, qint64( 0 ) ) ) + 1000 );
+}
+
+void PotdEngine::prepareForSleep( bool sleep )
+{
+    if ( !sleep ) {
+        checkDayChanged();
+    }
 }
 
 K_EXPORT_PLASMA_DATAENGINE_WITH_JSON(potdengine, PotdEngine, "plasma-dataengine-potd.json")
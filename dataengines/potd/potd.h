@@ -21,10 +21,17 @@
 #define POTD_DATAENGINE_H
 
 #include <Plasma/DataEngine>
+#include <KPluginFactory>
 #include <KPluginMetaData>
 
+#include <QPointer>
+
 class PotdProvider;
 
+class KDirWatch;
+
+class QDateTime;
+class QTime;
 class QTimer;
 
 /**
@@ -36,6 +43,20 @@ class QTimer;
  *   apod:2007-07-19
  *   unsplash:12435322
  *
+ * The source "Providers" lists the installed providers. They are looked up
+ * once the first source is requested, then the plugin directories are
+ * watched for providers being installed or removed. The factory of each
+ * provider is loaded once, when its first picture is requested.
+ *
+ * Pictures without a date in the query are updated once the day changed
+ * locally or, if the provider has a X-KDE-PlasmaPoTDProvider-PublishTime
+ * ("HH:mm" in UTC), once it published the next picture.
+ *
+ * The pictures are not decoded by the engine. A source has the "Url" of the
+ * cached file as a path and as a file url in "LocalUrl", the "Size" of the
+ * picture and when it was downloaded as "Modified"; the file at the url is
+ * replaced once a new picture arrived.
+ *
  */
 class PotdEngine : public Plasma::DataEngine
 {
@@ -55,12 +76,29 @@ class PotdEngine : public Plasma::DataEngine
         void finished( PotdProvider* );
         void error( PotdProvider* );
         void checkDayChanged();
-        void cachingFinished( const QString &source, const QString &path, const QImage &img );
+        void scheduleDayChange();
+        void prepareForSleep( bool sleep );
+        void cachingFinished( const QString &source, bool stored );
+        void loadProviders();
 
     private:
+        struct Provider {
+            KPluginMetaData metadata;
+            QPointer<KPluginFactory> factory;
+        };
+
+        void updateProvidersSource();
+        KPluginFactory *factory( const QString &providerName );
         bool updateSource( const QString &identifier, bool loadCachedAlways );
+        bool downloadSource( const QString &identifier );
+        void loadCached( const QString &identifier );
+        void setCachedData( const QString &identifier );
+        static bool isUndated( const QString &identifier );
+        QTime publishTime( const QString &identifier ) const;
+        bool isOutdated( const QString &identifier, const QDateTime &now ) const;
 
-        QMap<QString, KPluginMetaData> mFactories;
+        QHash<QString, Provider> mProviders;
+        KDirWatch *mPluginWatch;
         QTimer *m_checkDatesTimer;
         bool m_canDiscardCache;
 };
@@ -0,0 +1,260 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "potdcache.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QTextStream>
+#include <QTimer>
+
+// all pictures together, a few days of 4K pictures of some providers
+static const qint64 MAX_CACHE_SIZE = 64 * 1024 * 1024;
+// pictures used more recently might still be shown by another process
+static const qint64 MIN_EVICT_AGE = 24 * 60 * 60 * 1000;
+// how long to wait for another process writing the index
+static const int LOCK_TIMEOUT = 1000;
+// uses of cached pictures are written together, at the latest after this
+static const int SAVE_DELAY = 10000;
+
+static QString indexName()
+{
+    return QStringLiteral( "index" );
+}
+
+PotdCache *PotdCache::self()
+{
+    static PotdCache cache;
+    return &cache;
+}
+
+PotdCache::PotdCache()
+    : mDir( QStandardPaths::writableLocation( QStandardPaths::GenericCacheLocation ) + QLatin1String( "/plasma_engine_potd/" ) ),
+      mSize( 0 ),
+      mDirty( false )
+{
+    QDir().mkpath( mDir );
+    load();
+}
+
+QString PotdCache::path( const QString &identifier ) const
+{
+    return mDir + identifier;
+}
+
+bool PotdCache::contains( const QString &identifier ) const
+{
+    QMutexLocker locker( &mMutex );
+    // another process might have evicted it in the meantime
+    return mEntries.contains( identifier ) && QFile::exists( path( identifier ) );
+}
+
+QDateTime PotdCache::storedTime( const QString &identifier ) const
+{
+    QMutexLocker locker( &mMutex );
+    const auto it = mEntries.constFind( identifier );
+    if ( it == mEntries.constEnd() ) {
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch( it->stored );
+}
+
+QSize PotdCache::imageSize( const QString &identifier ) const
+{
+    QMutexLocker locker( &mMutex );
+    return mEntries.value( identifier ).imageSize;
+}
+
+void PotdCache::touch( const QString &identifier )
+{
+    QMutexLocker locker( &mMutex );
+    auto it = mEntries.find( identifier );
+    if ( it == mEntries.end() ) {
+        return;
+    }
+
+    // written with the next insert or a bit later, not for every use
+    it->used = QDateTime::currentMSecsSinceEpoch();
+    if ( !mDirty && QCoreApplication::instance() ) {
+        QTimer::singleShot( SAVE_DELAY, QCoreApplication::instance(), [this]() {
+            QMutexLocker locker( &mMutex );
+            if ( mDirty ) {
+                save();
+            }
+        } );
+    }
+    mDirty = true;
+}
+
+bool PotdCache::insert( const QString &identifier, const QByteArray &data, const QSize &imageSize )
+{
+    QSaveFile file( path( identifier ) );
+    if ( !file.open( QIODevice::WriteOnly ) || file.write( data ) != data.size() || !file.commit() ) {
+        qWarning() << "could not cache the picture" << identifier << file.errorString();
+        return false;
+    }
+
+    QMutexLocker locker( &mMutex );
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const auto it = mEntries.constFind( identifier );
+    if ( it != mEntries.constEnd() ) {
+        mSize -= it->size;
+    }
+    Entry entry;
+    entry.size = data.size();
+    entry.imageSize = imageSize;
+    entry.stored = now;
+    entry.used = now;
+    mEntries.insert( identifier, entry );
+    mSize += entry.size;
+    save( identifier );
+    return true;
+}
+
+qint64 PotdCache::size() const
+{
+    QMutexLocker locker( &mMutex );
+    return mSize;
+}
+
+qint64 PotdCache::maxSize() const
+{
+    return MAX_CACHE_SIZE;
+}
+
+void PotdCache::load()
+{
+    mEntries = read();
+    for ( auto it = mEntries.constBegin(); it != mEntries.constEnd(); ++it ) {
+        mSize += it->size;
+    }
+}
+
+QHash<QString, PotdCache::Entry> PotdCache::read() const
+{
+    // the index is replaced as a whole, it can be read without the lock
+    QHash<QString, Entry> entries;
+    QFile file( mDir + indexName() );
+    if ( !file.open( QIODevice::ReadOnly ) ) {
+        return entries;
+    }
+
+    QTextStream stream( &file );
+    stream.setCodec( "UTF-8" );
+    QString line;
+    while ( stream.readLineInto( &line ) ) {
+        // identifier, size, width, height, download and last use time
+        const QStringList fields = line.split( QLatin1Char( '\t' ) );
+        if ( fields.count() != 6 || !QFile::exists( path( fields[0] ) ) ) {
+            continue;
+        }
+        Entry entry;
+        entry.size = fields[1].toLongLong();
+        entry.imageSize = QSize( fields[2].toInt(), fields[3].toInt() );
+        entry.stored = fields[4].toLongLong();
+        entry.used = fields[5].toLongLong();
+        entries.insert( fields[0], entry );
+    }
+    return entries;
+}
+
+void PotdCache::merge( const QHash<QString, Entry> &entries )
+{
+    // the newest download and the last use in any process win
+    for ( auto it = entries.constBegin(); it != entries.constEnd(); ++it ) {
+        auto own = mEntries.find( it.key() );
+        if ( own == mEntries.end() ) {
+            mEntries.insert( it.key(), it.value() );
+            mSize += it->size;
+            continue;
+        }
+        if ( it->stored > own->stored ) {
+            mSize += it->size - own->size;
+            own->size = it->size;
+            own->imageSize = it->imageSize;
+            own->stored = it->stored;
+        }
+        own->used = qMax( own->used, it->used );
+    }
+
+    // pictures evicted by other processes
+    for ( auto it = mEntries.begin(); it != mEntries.end(); ) {
+        if ( QFile::exists( path( it.key() ) ) ) {
+            ++it;
+        } else {
+            mSize -= it->size;
+            it = mEntries.erase( it );
+        }
+    }
+}
+
+void PotdCache::save( const QString &keep )
+{
+    // other processes, e.g. the lock screen, share the cache, their changes
+    // are merged in before evicting and writing the index
+    QLockFile lock( mDir + indexName() + QLatin1String( ".lock" ) );
+    if ( !lock.tryLock( LOCK_TIMEOUT ) ) {
+        qWarning() << "could not lock the picture cache index" << lock.error();
+        return;
+    }
+    merge( read() );
+    evict( keep );
+
+    QSaveFile file( mDir + indexName() );
+    if ( !file.open( QIODevice::WriteOnly ) ) {
+        qWarning() << "could not write the picture cache index" << file.errorString();
+        return;
+    }
+
+    QTextStream stream( &file );
+    stream.setCodec( "UTF-8" );
+    for ( auto it = mEntries.constBegin(); it != mEntries.constEnd(); ++it ) {
+        stream << it.key() << '\t' << it->size << '\t' << it->imageSize.width() << '\t' << it->imageSize.height()
+               << '\t' << it->stored << '\t' << it->used << '\n';
+    }
+    stream.flush();
+    if ( file.commit() ) {
+        mDirty = false;
+    }
+}
+
+void PotdCache::evict( const QString &keep )
+{
+    const qint64 recent = QDateTime::currentMSecsSinceEpoch() - MIN_EVICT_AGE;
+    while ( mSize > MAX_CACHE_SIZE ) {
+        auto oldest = mEntries.end();
+        for ( auto it = mEntries.begin(); it != mEntries.end(); ++it ) {
+            if ( it.key() != keep && it->used < recent && ( oldest == mEntries.end() || it->used < oldest->used ) ) {
+                oldest = it;
+            }
+        }
+        if ( oldest == mEntries.end() ) {
+            return;
+        }
+
+        QFile::remove( path( oldest.key() ) );
+        mSize -= oldest->size;
+        mEntries.erase( oldest );
+    }
+}
@@ -0,0 +1,119 @@
+/*
+ *   Copyright (C) 2020 Plasma Addons developers
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Library General Public License version 2 as
+ *   published by the Free Software Foundation
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details
+ *
+ *   You should have received a copy of the GNU Library General Public
+ *   License along with this program; if not, write to the
+ *   Free Software Foundation, Inc.,
+ *   51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef POTDCACHE_H
+#define POTDCACHE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+
+/**
+ * This class manages the on-disk cache of the pictures of the day.
+ *
+ * The pictures are stored as they were downloaded, one file per identifier,
+ * in the cache location so they survive a restart. An index next to them
+ * remembers their size, their dimensions, when they were downloaded and when
+ * they were last used; it is read once and then kept in memory. Once all pictures together
+ * exceed maxSize() the least recently used ones are removed, except those
+ * used during the last day.
+ *
+ * Several processes use the cache at once, each merges the index written by
+ * the others with its own before writing it.
+ *
+ * All methods are thread safe, pictures are stored from worker threads.
+ */
+class PotdCache
+{
+    public:
+        /**
+         * Returns the cache of this process.
+         */
+        static PotdCache *self();
+
+        /**
+         * Returns the path of the file of @p identifier, it exists only
+         * if contains() returns true.
+         */
+        QString path( const QString &identifier ) const;
+
+        /**
+         * Returns whether a picture with the given @p identifier is cached.
+         */
+        bool contains( const QString &identifier ) const;
+
+        /**
+         * Returns when the picture of @p identifier was downloaded.
+         */
+        QDateTime storedTime( const QString &identifier ) const;
+
+        /**
+         * Returns the dimensions of the picture of @p identifier.
+         */
+        QSize imageSize( const QString &identifier ) const;
+
+        /**
+         * Marks the picture of @p identifier as used, so it is evicted last.
+         * The index is written a few seconds later or with the next insert().
+         */
+        void touch( const QString &identifier );
+
+        /**
+         * Stores the downloaded @p data of the picture of @p identifier,
+         * which is @p imageSize large, and evicts other pictures if the
+         * cache got too large.
+         */
+        bool insert( const QString &identifier, const QByteArray &data, const QSize &imageSize );
+
+        /**
+         * Returns the size of all cached pictures in bytes.
+         */
+        qint64 size() const;
+
+        /**
+         * Returns the maximum size of all cached pictures in bytes.
+         */
+        qint64 maxSize() const;
+
+    private:
+        struct Entry {
+            qint64 size;
+            QSize imageSize;
+            qint64 stored;
+            qint64 used;
+        };
+
+        PotdCache();
+
+        void load();
+        QHash<QString, Entry> read() const;
+        void merge( const QHash<QString, Entry> &entries );
+        void save( const QString &keep = QString() );
+        void evict( const QString &keep );
+
+        mutable QMutex mMutex;
+        const QString mDir;
+        QHash<QString, Entry> mEntries;
+        qint64 mSize;
+        bool mDirty;
+};
+
+#endif
@@ -28,6 +28,7 @@ public:
     QString name;
     QDate date;
     QString identifier;
+    QByteArray imageData;
 };
 
 PotdProvider::PotdProvider( QObject *parent, const QVariantList &args )
@@ -79,3 +80,13 @@ QString PotdProvider::identifier() const
 }
 
 
+
+QByteArray PotdProvider::imageData() const
+{
+    return d->imageData;
+}
+
+void PotdProvider::setImageData( const QByteArray &data )
+{
+    d->imageData = data;
+}
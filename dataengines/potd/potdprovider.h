@@ -20,6 +20,7 @@
 #ifndef POTDPROVIDER_H
 #define POTDPROVIDER_H
 
+#include <QByteArray>
 #include <QObject>
 #include <QVariantList>
 
@@ -77,6 +78,12 @@ class PLASMA_POTD_EXPORT PotdProvider : public QObject
          */
         bool isFixedDate() const;
 
+        /**
+         * Returns the picture as it was downloaded, so it can be stored
+         * without encoding it again. Empty if the provider did not set it.
+         */
+        QByteArray imageData() const;
+
     Q_SIGNALS:
         /**
          * This signal is emitted whenever a request has been finished
@@ -93,6 +100,13 @@ class PLASMA_POTD_EXPORT PotdProvider : public QObject
          */
         void error( PotdProvider *provider );
 
+    protected:
+        /**
+         * Sets the downloaded @p data of the picture, providers should call it
+         * before emitting finished().
+         */
+        void setImageData( const QByteArray &data );
+
     private:
         const QScopedPointer<class PotdProviderPrivate> d;
 };
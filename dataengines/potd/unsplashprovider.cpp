@@ -46,7 +46,7 @@ UnsplashProvider::~UnsplashProvider() = default;
 
 QImage UnsplashProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void UnsplashProvider::imageRequestFinished(KJob* _job)
@@ -57,7 +57,7 @@ void UnsplashProvider::imageRequestFinished(KJob* _job)
         return;
     }
     QByteArray data = job->data();
-    mImage = QImage::fromData(data);
+    setImageData(data);
     emit finished(this);
 }
 
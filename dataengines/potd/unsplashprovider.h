@@ -58,9 +58,6 @@ class UnsplashProvider : public PotdProvider
 
     private:
         void imageRequestFinished(KJob *job);
-
-    private:
-        QImage mImage;
 };
 
 #endif
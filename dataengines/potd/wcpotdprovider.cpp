@@ -52,7 +52,7 @@ WcpotdProvider::~WcpotdProvider() = default;
 
 QImage WcpotdProvider::image() const
 {
-    return mImage;
+    return QImage::fromData( imageData() );
 }
 
 void WcpotdProvider::pageRequestFinished(KJob *_job)
@@ -89,7 +89,7 @@ void WcpotdProvider::imageRequestFinished(KJob *_job)
 	return;
     }
     QByteArray data = job->data();
-    mImage = QImage::fromData( data );
+    setImageData( data );
     emit finished(this);
 }
 
@@ -64,9 +64,6 @@ class WcpotdProvider : public PotdProvider
     private:
         void pageRequestFinished(KJob *job);
         void imageRequestFinished(KJob *job);
-
-    private:
-        QImage mImage;
 };
 
 #endif
@@ -41,7 +41,7 @@
 
 QImage %{APPNAME}::image() const
 {
-    return mImage;
+    return QImage::fromData(imageData());
 }
 
 void %{APPNAME}::handleFinishedFeedRequest(KJob *job)
@@ -68,13 +68,8 @@ void %{APPNAME}::handleFinishedImageRequest(KJob *job)
         return;
     }
 
-    mImage = QImage::fromData(requestJob->data());
-
-    if (mImage.isNull()) {
-        emit error(this);
-        return;
-    }
-
+    // the engine caches the picture as downloaded, consumers decode it themselves
+    setImageData(requestJob->data());
     emit finished(this);
 }
 
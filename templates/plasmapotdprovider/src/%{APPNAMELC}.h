@@ -52,9 +52,6 @@ public:
 private:
     void handleFinishedFeedRequest(KJob *job);
     void handleFinishedImageRequest(KJob *job);
-
-private:
-    QImage mImage;
 };
 
 #endif
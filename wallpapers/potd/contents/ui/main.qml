@@ -18,8 +18,8 @@
  */
 
 import QtQuick 2.5
+import QtQuick.Window 2.2
 import org.kde.plasma.core 2.0 as PlasmaCore
-import org.kde.kquickcontrolsaddons 2.0
 
 Rectangle {
     id: root
@@ -43,10 +43,19 @@ Rectangle {
         }
     }
 
-    QImageItem {
+    Image {
+        readonly property var picture: engine.data[identifier]
+
         anchors.fill: parent
-        image: engine.data[identifier].Image
+        // the file is replaced by the next picture, the query makes it reload
+        source: picture && picture.Url ? picture.LocalUrl + "?" + picture.Modified.getTime() : ""
+        // decode it only as large as it is shown when it gets scaled, centered
+        // and tiled pictures are shown at their own size
+        sourceSize: fillMode === Image.Stretch || fillMode === Image.PreserveAspectFit || fillMode === Image.PreserveAspectCrop
+                    ? Qt.size(width * Screen.devicePixelRatio, height * Screen.devicePixelRatio) : undefined
         fillMode: wallpaper.configuration.FillMode
+        asynchronous: true
+        cache: false
         smooth: true
     }
 }